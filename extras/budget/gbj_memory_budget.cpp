@@ -0,0 +1,214 @@
+/*
+  NAME:
+  Performance budget of gbjMemory library.
+
+  DESCRIPTION:
+  The host program runs representative workloads of the library against
+  a simulated EEPROM AT24C32 of the stub gbj_twowire.h and compares their
+  costs with golden values. It exits with failure status at any regression,
+  so that it can be run by a build script or continuous integration.
+  - Workloads are configuration save, log append, full dump, erase, scattered
+    reads, and a page write failing on the bus.
+  - Costs are counted by the stub independently of the library, i.e., bus
+    transfers, bytes on the wire including device addresses, and page
+    programs. Bus time is predicted by the timing model gbj_memory_timing.h
+    from the wire traffic.
+  - Golden values are fixed constants derived from the memory geometry, i.e.,
+    4096 bytes in pages of 32 bytes with 2 bytes of position prefix, and from
+    the layout of workloads. They are not computed by formulas of the library.
+    Golden bus time comes from the fast mode at 400 kHz, i.e., 22.5 us per
+    byte with acknowledge and 2.5 us per transfer for start and stop
+    conditions and bus free time.
+  - A workload costing more than its golden value is a regression, e.g., an
+    additional transaction in storeStream() or retrieveStream(), or more page
+    programs at erase. A workload costing less is reported as an improvement
+    and its golden values should be updated.
+
+  USAGE:
+  g++ -std=c++11 -I../../src -I. gbj_memory_budget.cpp -o budget
+  ./budget
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#include "gbj_twowire.h"
+#include "gbj_memory.h"
+
+const uint16_t MEMORY_POSITION_MAX = 0x0FFF;
+const uint16_t MEMORY_PAGE_SIZE = 32;
+const uint16_t LOG_POSITION = 0x0400;
+const uint8_t LOG_RECORDS = 64;
+const uint8_t DUMP_CHUNK = 32;
+
+struct Config
+{
+  uint32_t serial;
+  uint16_t interval;
+  uint8_t flags;
+  char name[17];
+};
+struct Record
+{
+  uint32_t timestamp;
+  int16_t values[4];
+};
+struct Cost
+{
+  unsigned long transfers;
+  unsigned long wireBytes;
+  unsigned long programs;
+  // Modeled bus time in nanoseconds
+  unsigned long long busTime;
+};
+// Golden bus time in fast mode
+const unsigned long long BYTE_NS = 22500;
+const unsigned long long TRANSFER_NS = 2500;
+
+gbj_memory device = gbj_memory(gbj_memory::CLOCK_400KHZ);
+unsigned regressions;
+
+void startWorkload()
+{
+  sim.transfers = sim.wireBytes = sim.programs = 0;
+  sim.busTime = 0;
+  sim.failTransfer = 0;
+}
+
+void finishWorkload(const char *name, const Cost &golden, bool failure = false)
+{
+  Cost measured = { sim.transfers, sim.wireBytes, sim.programs, sim.busTime };
+  bool regression = measured.transfers > golden.transfers ||
+                    measured.wireBytes > golden.wireBytes ||
+                    measured.programs > golden.programs ||
+                    measured.busTime > golden.busTime ||
+                    device.isError() != failure;
+  bool improvement = !regression &&
+                     (measured.transfers < golden.transfers ||
+                      measured.wireBytes < golden.wireBytes ||
+                      measured.programs < golden.programs ||
+                      measured.busTime < golden.busTime);
+  regressions += regression;
+  printf("%-16s %5lu/%-5lu %6lu/%-6lu %5lu/%-5lu %9.1f/%-9.1f  %s\n",
+         name,
+         measured.transfers,
+         golden.transfers,
+         measured.wireBytes,
+         golden.wireBytes,
+         measured.programs,
+         golden.programs,
+         measured.busTime / 1e3,
+         golden.busTime / 1e3,
+         regression ? "REGRESSION" : (improvement ? "IMPROVED" : "PASS"));
+}
+
+int main()
+{
+  sim.capacity = MEMORY_POSITION_MAX + 1;
+  sim.pageSize = MEMORY_PAGE_SIZE;
+  memset(sim.data, 0xFF, sizeof(sim.data));
+  if (device.begin(MEMORY_POSITION_MAX, MEMORY_PAGE_SIZE))
+  {
+    fprintf(stderr, "Begin failed\n");
+    return 1;
+  }
+  printf("Bus clock: %lu kHz\n",
+         static_cast<unsigned long>(device.getBusClock() / 1000));
+  printf("%-16s %11s %13s %11s %19s\n",
+         "Workload",
+         "transfers",
+         "wire bytes",
+         "programs",
+         "model us");
+
+  // Configuration save of 24 bytes in one page:
+  // one transfer of device address, prefix, and data
+  Config config = { 0x12345678, 60, 0x05, "budget" };
+  startWorkload();
+  device.store(0, config);
+  finishWorkload("Config save", { 1, 27, 1, TRANSFER_NS + 27 * BYTE_NS });
+
+  // Log append of 64 records of 12 bytes from a page start: 768 bytes in 24
+  // pages, 16 of 23 inner page boundaries are not multiples of 12, so that
+  // 80 page writes with 2 prefix bytes and the device address each
+  Record record = { 0, { 1, 2, 3, 4 } };
+  startWorkload();
+  for (uint8_t i = 0; i < LOG_RECORDS; i++)
+  {
+    record.timestamp = i;
+    if (device.store(LOG_POSITION + i * sizeof(record), record))
+    {
+      break;
+    }
+  }
+  finishWorkload(
+    "Log append",
+    { 80, 80 * 3 + 768, 80, 80 * TRANSFER_NS + (80 * 3 + 768) * BYTE_NS });
+
+  // Full dump of 4096 bytes by 128 chunks of the read cursor: the first one
+  // addressed by the prefix, the rest at the current address
+  uint8_t buffer[DUMP_CHUNK];
+  startWorkload();
+  device.seek(0);
+  for (uint16_t i = 0; i < (MEMORY_POSITION_MAX + 1) / DUMP_CHUNK; i++)
+  {
+    if (device.readNext(buffer, DUMP_CHUNK))
+    {
+      break;
+    }
+  }
+  finishWorkload(
+    "Full dump",
+    { 2 + 127, 3 + 128 * 33, 0, 129 * TRANSFER_NS + 4227 * BYTE_NS });
+
+  // Erase of 128 pages with one program per page
+  startWorkload();
+  device.erase();
+  finishWorkload(
+    "Erase", { 128, 128 * 35, 128, 128 * TRANSFER_NS + 128 * 35 * BYTE_NS });
+
+  // Scattered reads of 4 bytes merged to 5 addressed runs: 100~112, 1000,
+  // 1010, 2000, and 3000~3008, because gaps of 6 bytes exceed the break-even
+  // gap of 3 bytes with word prefix at 400 kHz
+  const uint8_t REQUESTS = 8;
+  const uint16_t positions[REQUESTS] = { 3004, 100,  104,  108,
+                                         1000, 1010, 2000, 3000 };
+  uint8_t data[REQUESTS][4];
+  gbj_memory::ReadRequest requests[REQUESTS];
+  for (uint8_t i = 0; i < REQUESTS; i++)
+  {
+    requests[i].position = positions[i];
+    requests[i].dataBuffer = data[i];
+    requests[i].dataLen = sizeof(data[i]);
+  }
+  startWorkload();
+  device.retrieveBatch(requests, REQUESTS);
+  finishWorkload("Scattered reads",
+                 { 10, 5 * 3 + 13 + 3 * 5 + 9, 0,
+                   10 * TRANSFER_NS + 52 * BYTE_NS });
+
+  // Write of 64 bytes in 2 pages failing at the second page without retries:
+  // the first page is programmed once, the failed transfer is not repeated,
+  // and the progress is the first page
+  uint8_t block[2 * MEMORY_PAGE_SIZE] = {};
+  startWorkload();
+  sim.failTransfer = 2;
+  device.storeStream(LOG_POSITION, block, sizeof(block));
+  finishWorkload("Failed write",
+                 { 2, 2 * 35, 1, 2 * TRANSFER_NS + 2 * 35 * BYTE_NS },
+                 true);
+  if (device.getProgress() != MEMORY_PAGE_SIZE)
+  {
+    printf("Failed write progress %u instead of %u: REGRESSION\n",
+           device.getProgress(),
+           MEMORY_PAGE_SIZE);
+    regressions++;
+  }
+
+  printf("Regressions: %u\n", regressions);
+  return regressions ? 1 : 0;
+}
@@ -0,0 +1,256 @@
+/*
+  NAME:
+  Host stub of the parent library gbjTwoWire for the performance budget.
+
+  DESCRIPTION:
+  The header replaces the Arduino framework and the parent library gbjTwoWire
+  on a host computer, so that the library gbjMemory runs against a simulated
+  EEPROM without any hardware.
+  - The simulated EEPROM receives the position prefix most significant byte
+    first, wraps writes within a memory page, and keeps its address counter
+    for current address reads. Position bits folded to the lowest 3 bits of
+    the device address, e.g., of AT24C16, are placed above the prefix.
+  - Costs are counted by the stub independently of the library, i.e., bus
+    transfers, bytes on the wire including device addresses, page programs,
+    and predicted bus time by the timing model gbj_memory_timing.h.
+  - A transfer can be failed on purpose by the acknowledge of its data, so
+    that recovery of the library is tested as well.
+  - The transmit buffer of the two-wire library is 128 bytes as on ESP32 by
+    default. Another platform is simulated by the macro I2C_BUFFER_LENGTH.
+  - The header defines global objects and must be included by just one
+    translation unit.
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#ifndef GBJ_TWOWIRE_H
+#define GBJ_TWOWIRE_H
+
+#include "gbj_memory_timing.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef I2C_BUFFER_LENGTH
+  #define I2C_BUFFER_LENGTH 128
+#endif
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(x, low, high) \
+  ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+typedef uint8_t byte;
+
+// Time is not simulated, durations come from the timing model
+inline unsigned long millis() { return 0; }
+inline unsigned long micros() { return 0; }
+inline void delay(unsigned long) {}
+inline void delayMicroseconds(unsigned int) {}
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return HIGH; }
+
+class Print
+{
+public:
+  virtual size_t write(uint8_t data) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size)
+  {
+    size_t written = 0;
+    while (size--)
+    {
+      written += write(*buffer++);
+    }
+    return written;
+  }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+  virtual ~Print() {}
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+struct TwoWire
+{
+  void begin() {}
+  void end() {}
+} Wire;
+
+// Simulated EEPROM with counters of costs
+struct SimMemory
+{
+  uint8_t data[0x10000];
+  uint32_t capacity;
+  uint16_t pageSize;
+  uint32_t address;
+  // Number of the transfer to be failed, counted from 1, none if zero
+  unsigned long failTransfer;
+  unsigned long transfers;
+  unsigned long wireBytes;
+  unsigned long programs;
+  unsigned long long busTime;
+} sim;
+
+class gbj_twowire
+{
+public:
+  enum ResultCodes : uint8_t
+  {
+    SUCCESS = 0,
+    ERROR_BUFFER = 1,
+    ERROR_NACK_ADDR = 2,
+    ERROR_NACK_DATA = 3,
+    ERROR_NACK_OTHER = 4,
+    ERROR_ADDR = 5,
+    ERROR_PINS = 6,
+    ERROR_RCV_DATA = 7,
+    ERROR_POSITION = 8,
+  };
+  enum ClockSpeeds : uint32_t
+  {
+    CLOCK_100KHZ = 100000,
+    CLOCK_400KHZ = 400000,
+  };
+
+  gbj_twowire(ClockSpeeds clockSpeed = CLOCK_100KHZ,
+              uint8_t pinSDA = 4,
+              uint8_t pinSCL = 5)
+    : clock_(clockSpeed)
+    , pinSDA_(pinSDA)
+    , pinSCL_(pinSCL){};
+
+  inline ResultCodes begin() { return setLastResult(); }
+  inline ResultCodes busSendStream(uint8_t *prefix,
+                                   uint16_t prefixLen,
+                                   bool reverse = false)
+  {
+    if (transfer(prefixLen))
+    {
+      return getLastResult();
+    }
+    sim.address = decode(prefix, prefixLen, reverse);
+    return getLastResult();
+  }
+  inline ResultCodes busSendStreamPrefixed(uint8_t *dataBuffer,
+                                           uint16_t dataLen,
+                                           bool,
+                                           uint8_t *prefix,
+                                           uint16_t prefixLen,
+                                           bool reverse = false,
+                                           bool = true)
+  {
+    if (transfer(prefixLen + dataLen))
+    {
+      return getLastResult();
+    }
+    uint32_t position = decode(prefix, prefixLen, reverse);
+    uint32_t page = position - position % sim.pageSize;
+    for (uint16_t i = 0; i < dataLen; i++)
+    {
+      uint32_t offset = (position - page + i) % sim.pageSize;
+      sim.data[(page + offset) % sim.capacity] = dataBuffer[i];
+    }
+    sim.address = position + dataLen;
+    sim.programs++;
+    return getLastResult();
+  }
+  inline ResultCodes busReceive(uint8_t *dataBuffer,
+                                uint16_t dataLen,
+                                uint8_t = 0)
+  {
+    if (transfer(dataLen))
+    {
+      return getLastResult();
+    }
+    for (uint16_t i = 0; i < dataLen; i++)
+    {
+      dataBuffer[i] = sim.data[sim.address++ % sim.capacity];
+    }
+    return getLastResult();
+  }
+
+  // Setters
+  inline ResultCodes setLastResult(ResultCodes result = SUCCESS)
+  {
+    return lastResult_ = result;
+  }
+  inline ResultCodes setAddress(uint8_t address)
+  {
+    address_ = address;
+    return setLastResult();
+  }
+  inline void setBusClock(uint32_t clock) { clock_ = clock; }
+  inline void setDelaySend(uint32_t delay) { delaySend_ = delay; }
+  inline void setBusStop() {}
+  inline void setBusRepeat() {}
+
+  // Getters
+  inline ResultCodes getLastResult() { return lastResult_; }
+  inline bool isSuccess() { return lastResult_ == SUCCESS; }
+  inline bool isSuccess(ResultCodes result)
+  {
+    setLastResult(result);
+    return isSuccess();
+  }
+  inline bool isError() { return !isSuccess(); }
+  inline bool isError(ResultCodes result)
+  {
+    setLastResult(result);
+    return isError();
+  }
+  inline uint8_t getAddress() { return address_; }
+  inline uint32_t getBusClock() { return clock_; }
+  inline uint32_t getDelaySend() { return delaySend_; }
+  inline uint8_t getPinSDA() { return pinSDA_; }
+  inline uint8_t getPinSCL() { return pinSCL_; }
+
+private:
+  ResultCodes lastResult_ = SUCCESS;
+  uint32_t clock_;
+  uint32_t delaySend_ = 0;
+  uint8_t address_ = 0x50;
+  uint8_t pinSDA_;
+  uint8_t pinSCL_;
+
+  // Count a transfer with the device address and fail it on purpose
+  inline ResultCodes transfer(uint16_t bytes)
+  {
+    sim.transfers++;
+    sim.wireBytes += 1 + bytes;
+    sim.busTime += gbj_memory_timing::transferTime(
+      gbj_memory_timing::busTiming(clock_), 1 + bytes);
+    if (sim.transfers == sim.failTransfer)
+    {
+      return setLastResult(ERROR_NACK_DATA);
+    }
+    return setLastResult();
+  }
+  // Position from the prefix in wire order and the folded device address
+  inline uint32_t decode(uint8_t *prefix, uint16_t prefixLen, bool reverse)
+  {
+    uint32_t position = address_ & 0x07;
+    for (uint16_t i = 0; i < prefixLen; i++)
+    {
+      position = position << 8 | prefix[reverse ? prefixLen - 1 - i : i];
+    }
+    return position;
+  }
+};
+
+#endif
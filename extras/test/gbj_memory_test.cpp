@@ -0,0 +1,202 @@
+/*
+  NAME:
+  Host tests of gbjMemory library.
+
+  DESCRIPTION:
+  The host program checks recovery of the library and its companions from
+  failures against a simulated EEPROM AT24C32 of the stub gbj_twowire.h of
+  the performance budget. It exits with failure status at any failed check,
+  so that it can be run by a build script or continuous integration.
+  - Each test starts with an erased memory and a memory object in default
+    state, fails a transfer on purpose, and checks the state of the library
+    and the content of the simulated memory.
+
+  USAGE:
+  g++ -std=c++11 -I../../src -I../budget gbj_memory_test.cpp -o test
+  ./test
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#include "gbj_twowire.h"
+#include "gbj_memory.h"
+#include "gbj_memory_counter.h"
+#include "gbj_memory_pool.h"
+#include "gbj_memory_tester.h"
+
+const uint16_t MEMORY_POSITION_MAX = 0x0FFF;
+const uint16_t MEMORY_PAGE_SIZE = 32;
+
+unsigned failures;
+
+void check(bool condition, const char *name)
+{
+  if (!condition)
+  {
+    printf("FAILED: %s\n", name);
+    failures++;
+  }
+}
+
+// Erased memory without any failing transfer
+void startTest(gbj_memory &memory)
+{
+  sim.capacity = MEMORY_POSITION_MAX + 1;
+  sim.pageSize = MEMORY_PAGE_SIZE;
+  sim.transfers = sim.wireBytes = sim.programs = 0;
+  sim.failTransfer = 0;
+  memset(sim.data, 0xFF, sizeof(sim.data));
+  memory.begin(MEMORY_POSITION_MAX, MEMORY_PAGE_SIZE);
+}
+
+// Failed flush keeps the fragment pending and does not count it as progress
+void testFlushFailure()
+{
+  gbj_memory memory;
+  uint8_t page[MEMORY_PAGE_SIZE];
+  uint8_t data[2 * MEMORY_PAGE_SIZE];
+  memset(data, 0x5A, sizeof(data));
+  startTest(memory);
+  memory.setWriteCombine(page);
+  memory.storeStream(200, data, 4);
+  check(memory.getProgress() == 0, "flush: buffered bytes not in progress");
+  sim.failTransfer = sim.transfers + 1;
+  check(memory.flush() == gbj_memory::ERROR_NACK_DATA, "flush: failure");
+  check(memory.getWritePending(), "flush: pending after failure");
+  check(sim.data[200] == 0xFF, "flush: memory untouched after failure");
+  check(memory.flush() == gbj_memory::SUCCESS, "flush: repeated");
+  check(!memory.getWritePending(), "flush: not pending after success");
+  check(sim.data[200] == 0x5A, "flush: memory written by repeated flush");
+  // Combined stream failing at flushing its first page
+  startTest(memory);
+  memory.setWriteCombine(page);
+  sim.failTransfer = sim.transfers + 1;
+  memory.storeStream(16, data, MEMORY_PAGE_SIZE);
+  check(memory.isError(), "flush: stream failure");
+  check(memory.getProgress() == 0, "flush: no progress of stream");
+  check(memory.getWritePending(), "flush: first page pending");
+  check(memory.flush() == gbj_memory::SUCCESS, "flush: first page written");
+  check(sim.data[16] == 0x5A && sim.data[31] == 0x5A,
+        "flush: first page content");
+}
+
+// Torn slot with correct residue does not turn the counter backwards
+void testCounterTornSlot()
+{
+  const uint16_t POSITION = 0x0200;
+  gbj_memory memory;
+  gbj_memory_counter<64> counter(memory);
+  startTest(memory);
+  counter.begin(POSITION);
+  counter.format();
+  for (uint16_t i = 0; i < 255; i++)
+  {
+    counter.increment();
+  }
+  // Slot 0 holds 192, a torn byte turns it to 448
+  sim.data[POSITION + 1] = 0x01;
+  sim.transfers = 0;
+  check(counter.begin(POSITION) == gbj_memory::SUCCESS, "counter: begin");
+  // Two passes over 8 pages, each burst addressed and received
+  check(sim.transfers == 2 * 8 * 2, "counter: begin in page bursts");
+  check(counter.getValue() == 448, "counter: torn maximum");
+  check(counter.getInvalidSlots() == 63, "counter: stale slots invalid");
+  for (uint8_t i = 0; i < 10; i++)
+  {
+    counter.increment();
+  }
+  check(counter.getValue() == 458, "counter: incremented");
+  counter.begin(POSITION);
+  check(counter.getValue() == 458, "counter: recovered after reboot");
+}
+
+// Companion of a memory with position bits folded to the device address
+void testCompanionFolded()
+{
+  const uint16_t POSITION = 0x0500;
+  typedef gbj_memory_t<gbj_memory_address::AddressAt24c16> Memory;
+  Memory memory;
+  gbj_memory_counter<16, Memory> counter(memory);
+  sim.capacity = 0x0800;
+  sim.pageSize = 16;
+  sim.failTransfer = 0;
+  memset(sim.data, 0xFF, sizeof(sim.data));
+  check(memory.begin(0x07FF, 16) == Memory::SUCCESS, "folded: begin");
+  counter.begin(POSITION);
+  counter.format();
+  for (uint8_t i = 0; i < 20; i++)
+  {
+    counter.increment();
+  }
+  check(sim.data[POSITION + 4 * 4] == 20, "folded: slot in upper block");
+  gbj_memory_counter<16, Memory> recovered(memory);
+  recovered.begin(POSITION);
+  check(recovered.getValue() == 20, "folded: recovered");
+}
+
+// Validation failures of companions are reported by the memory as well
+void testCompanionResult()
+{
+  gbj_memory memory;
+  gbj_memory_pool<uint32_t, 4> pool(memory);
+  uint16_t slot;
+  startTest(memory);
+  pool.begin(0x0100);
+  pool.format();
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    pool.add(i, slot);
+  }
+  check(pool.add(4, slot) == gbj_memory::ERROR_POSITION, "result: pool full");
+  check(memory.getLastResult() == gbj_memory::ERROR_POSITION,
+        "result: pool full by memory");
+  gbj_memory_counter<16> counter(memory);
+  memory.setLastResult();
+  counter.begin(0x0201);
+  check(memory.getLastResult() == gbj_memory::ERROR_POSITION,
+        "result: counter unaligned by memory");
+}
+
+// Tester programs every chunk even with write combining
+void testTesterCombining()
+{
+  gbj_memory memory;
+  gbj_memory_tester<> tester(memory);
+  uint8_t page[MEMORY_PAGE_SIZE];
+  startTest(memory);
+  memory.setWriteCombine(page);
+  check(tester.checkerboard(0, 48) == gbj_memory::SUCCESS, "tester: run");
+  check(!memory.getWritePending(), "tester: nothing pending");
+  check(sim.data[40] == 0xAA && sim.data[47] == 0x55,
+        "tester: partial page programmed");
+  check(tester.getReport().errors == 0, "tester: no errors");
+}
+
+// Empty batch succeeds regardless of a previous error
+void testBatchEmpty()
+{
+  gbj_memory memory;
+  gbj_memory::ReadRequest request;
+  startTest(memory);
+  memory.setLastResult(gbj_memory::ERROR_NACK_DATA);
+  check(memory.retrieveBatch(&request, 0) == gbj_memory::SUCCESS,
+        "batch: empty");
+  check(sim.transfers == 0, "batch: empty without traffic");
+}
+
+int main()
+{
+  testFlushFailure();
+  testCounterTornSlot();
+  testCompanionFolded();
+  testCompanionResult();
+  testTesterCombining();
+  testBatchEmpty();
+  printf("Failures: %u\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,372 @@
+/*
+  NAME:
+  Host analyzer of gbjMemory bus transaction traces.
+
+  DESCRIPTION:
+  The program reads a binary trace captured from the library gbjMemory, e.g.,
+  by redirecting serial port output of the methods setTrace(Serial) or
+  dumpTrace(Serial) to a file, and reports performance statistics.
+  - It summarizes transactions by type with their count, bytes, total, average
+    and maximal duration, and failures.
+  - It reports idle gaps between transactions and write throughput.
+  - It reports adjacent transactions, which could have been merged, i.e.,
+    page writes continuing within the same memory page and reads continuing
+    at the end of the previous read, with time saved by merging them
+    including typical write cycles.
+  - It reports unaligned page splits, i.e., streams of consecutive page writes
+    programming more pages than their length needs, because they do not start
+    at a memory page boundary.
+  - It replays the trace at standard, fast, and fast plus bus modes by the
+    timing model of the header gbj_memory_timing.h with start and stop
+    conditions, acknowledge bits, clock stretching, and EEPROM write cycles,
+    and it reports predicted microseconds per transaction type with typical
+    write cycles and the total with typical and maximal write cycles. So that
+    the benefit of a faster bus can be estimated offline.
+  - It reports the break-even gap of batch reads for every bus mode, i.e., the
+    number of bytes read through in the time of addressing, so that over-read
+    and re-addressing can be compared offline.
+
+  USAGE:
+  g++ -std=c++11 -I../../src gbj_memory_trace_analyzer.cpp -o analyzer
+  ./analyzer trace.bin [prefixLen] [stretch] [pageSize]
+  - prefixLen is the number of position bytes, 1 to 3, default 2.
+  - stretch is the clock stretching per byte in nanoseconds, default 0.
+  - pageSize is the page size of the memory in bytes, default 32.
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#include "gbj_memory_timing.h"
+#include "gbj_memory_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace gbj_memory_trace;
+using namespace gbj_memory_timing;
+
+struct Summary
+{
+  unsigned long count, bytes, failures;
+  unsigned long long duration;
+  unsigned long durationMax;
+};
+
+// Stream of page writes continuing at page boundaries
+struct Stream
+{
+  uint32_t position, length;
+  unsigned long programs;
+};
+
+// Number of pages programmed above the minimum for the stream length
+static unsigned long extraPrograms(const Stream &stream, unsigned pageSize)
+{
+  unsigned long programsMin = (stream.length + pageSize - 1) / pageSize;
+  return stream.programs > programsMin ? stream.programs - programsMin : 0;
+}
+
+static bool isRead(uint8_t type)
+{
+  return type == TRACE_READ || type == TRACE_CURRENT;
+}
+
+static const char *typeName(uint8_t type)
+{
+  switch (type)
+  {
+    case TRACE_WRITE:
+      return "write";
+    case TRACE_READ:
+      return "read";
+    case TRACE_CURRENT:
+      return "current";
+    case TRACE_POLL:
+      return "poll";
+    case TRACE_CLEAR:
+      return "clear";
+    default:
+      return "unknown";
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    fprintf(stderr,
+            "Usage: %s trace.bin [prefixLen] [stretch] [pageSize]\n",
+            argv[0]);
+    return 1;
+  }
+  unsigned prefixLen = argc > 2 ? atoi(argv[2]) : 2;
+  unsigned stretch = argc > 3 ? atoi(argv[3]) : 0;
+  unsigned pageSize = argc > 4 ? atoi(argv[4]) : 32;
+  if (pageSize == 0)
+  {
+    fprintf(stderr, "Invalid page size\n");
+    return 1;
+  }
+  FILE *file = fopen(argv[1], "rb");
+  if (file == NULL)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+  // Scan for sync bytes, so that text output mixed into the capture is skipped
+  std::vector<TraceRecord> records;
+  int prev = EOF, c;
+  while ((c = fgetc(file)) != EOF)
+  {
+    if (prev == TRACE_SYNC[0] && c == TRACE_SYNC[1])
+    {
+      uint8_t packed[TRACE_RECORD_LEN];
+      if (fread(packed, 1, sizeof(packed), file) != sizeof(packed))
+      {
+        break;
+      }
+      TraceRecord record;
+      unpack(packed, record);
+      records.push_back(record);
+      c = EOF;
+    }
+    prev = c;
+  }
+  fclose(file);
+  if (records.empty())
+  {
+    fprintf(stderr, "No trace records found\n");
+    return 1;
+  }
+
+  Summary summary[TRACE_CLEAR + 1] = {};
+  unsigned long long gaps = 0, busy = 0;
+  unsigned long gapMax = 0;
+  const BusTiming buses[] = { BUS_STANDARD, BUS_FAST, BUS_FAST_PLUS };
+  const size_t BUSES = sizeof(buses) / sizeof(buses[0]);
+  // Predicted durations in nanoseconds by bus mode and type with typical
+  // write cycles and total durations with maximal ones
+  unsigned long long predicted[BUSES][TRACE_CLEAR + 1] = {};
+  unsigned long long predictedMax[BUSES] = {};
+  // Adjacent transactions and bus time saved by merging them
+  unsigned long mergeWrites = 0, mergeReads = 0;
+  unsigned long long mergeSaved[BUSES] = {};
+  // Unaligned page splits with their first positions
+  const size_t SPLITS_LISTED = 8;
+  std::vector<uint32_t> splits;
+  unsigned long splitPrograms = 0;
+  Stream stream = {};
+  for (size_t i = 0; i < records.size(); i++)
+  {
+    const TraceRecord &record = records[i];
+    uint8_t type = record.type <= TRACE_CLEAR ? record.type : 0;
+    Summary &s = summary[type];
+    s.count++;
+    s.bytes += record.type == TRACE_POLL ? 0 : record.length;
+    s.failures += record.result != 0;
+    s.duration += record.duration;
+    if (record.duration > s.durationMax)
+    {
+      s.durationMax = record.duration;
+    }
+    busy += record.duration;
+    if (i)
+    {
+      const TraceRecord &last = records[i - 1];
+      // Unsigned arithmetic survives overflow of microseconds timer
+      uint32_t gap = record.timestamp - last.timestamp - last.duration;
+      if (gap < 0x80000000UL)
+      {
+        gaps += gap;
+        gapMax = gap > gapMax ? gap : gapMax;
+      }
+      bool adjacent = record.result == 0 && last.result == 0 &&
+                      record.position == last.position + last.length;
+      bool samePage =
+        record.position / pageSize == last.position / pageSize;
+      bool mergeable = false;
+      if (adjacent && record.type == TRACE_WRITE &&
+          last.type == TRACE_WRITE && samePage)
+      {
+        mergeWrites++;
+        mergeable = true;
+      }
+      if (adjacent && isRead(record.type) && isRead(last.type))
+      {
+        mergeReads++;
+        mergeable = true;
+      }
+      for (size_t bus = 0; mergeable && bus < BUSES; bus++)
+      {
+        mergeSaved[bus] += transactionTime(buses[bus],
+                                           last.type,
+                                           last.length,
+                                           prefixLen,
+                                           stretch,
+                                           WRITE_EEPROM.typical) +
+                           transactionTime(buses[bus],
+                                           record.type,
+                                           record.length,
+                                           prefixLen,
+                                           stretch,
+                                           WRITE_EEPROM.typical) -
+                           transactionTime(buses[bus],
+                                           last.type,
+                                           last.length + record.length,
+                                           prefixLen,
+                                           stretch,
+                                           WRITE_EEPROM.typical);
+      }
+    }
+    if (record.type == TRACE_WRITE && record.result == 0)
+    {
+      if (stream.programs && record.position % pageSize == 0 &&
+          record.position == stream.position + stream.length)
+      {
+        stream.length += record.length;
+        stream.programs++;
+      }
+      else
+      {
+        if (extraPrograms(stream, pageSize))
+        {
+          splits.push_back(stream.position);
+          splitPrograms += extraPrograms(stream, pageSize);
+        }
+        stream.position = record.position;
+        stream.length = record.length;
+        stream.programs = 1;
+      }
+    }
+    for (size_t bus = 0; bus < BUSES; bus++)
+    {
+      predicted[bus][type] += transactionTime(buses[bus],
+                                              record.type,
+                                              record.length,
+                                              prefixLen,
+                                              stretch,
+                                              WRITE_EEPROM.typical);
+      predictedMax[bus] += transactionTime(buses[bus],
+                                           record.type,
+                                           record.length,
+                                           prefixLen,
+                                           stretch,
+                                           WRITE_EEPROM.maximal);
+    }
+  }
+  if (extraPrograms(stream, pageSize))
+  {
+    splits.push_back(stream.position);
+    splitPrograms += extraPrograms(stream, pageSize);
+  }
+  uint32_t span = records.back().timestamp + records.back().duration -
+                  records.front().timestamp;
+
+  printf("Records: %zu, span: %lu us, busy: %llu us, idle: %llu us"
+         " (max gap %lu us)\n",
+         records.size(),
+         static_cast<unsigned long>(span),
+         busy,
+         gaps,
+         gapMax);
+  printf("%-8s %8s %10s %12s %10s %10s %8s\n",
+         "type",
+         "count",
+         "bytes",
+         "total us",
+         "avg us",
+         "max us",
+         "failed");
+  for (uint8_t type = 0; type <= TRACE_CLEAR; type++)
+  {
+    const Summary &s = summary[type];
+    if (s.count == 0)
+    {
+      continue;
+    }
+    printf("%-8s %8lu %10lu %12llu %10llu %10lu %8lu\n",
+           typeName(type),
+           s.count,
+           s.bytes,
+           s.duration,
+           s.duration / s.count,
+           s.durationMax,
+           s.failures);
+  }
+  if (summary[TRACE_WRITE].duration)
+  {
+    printf("Write throughput: %.1f B/s including write cycles\n",
+           1e6 * summary[TRACE_WRITE].bytes / span);
+  }
+  // Access pattern of the application
+  printf("Mergeable: %lu writes within a page, %lu adjacent reads\n",
+         mergeWrites,
+         mergeReads);
+  printf("Unaligned page splits: %zu streams, %lu extra page programs\n",
+         splits.size(),
+         splitPrograms);
+  for (size_t i = 0; i < splits.size() && i < SPLITS_LISTED; i++)
+  {
+    printf("  stream at 0x%04lX\n", static_cast<unsigned long>(splits[i]));
+  }
+  if (splits.size() > SPLITS_LISTED)
+  {
+    printf("  ... %zu more\n", splits.size() - SPLITS_LISTED);
+  }
+  // Replay by the timing model at standard bus modes
+  printf("Predicted avg us per transaction (stretch %u ns per byte,"
+         " write cycle %lu us):\n",
+         stretch,
+         static_cast<unsigned long>(WRITE_EEPROM.typical));
+  printf("%-8s", "type");
+  for (size_t bus = 0; bus < BUSES; bus++)
+  {
+    printf(" %9lu Hz", static_cast<unsigned long>(buses[bus].clock));
+  }
+  printf("\n");
+  for (uint8_t type = 0; type <= TRACE_CLEAR; type++)
+  {
+    if (summary[type].count == 0)
+    {
+      continue;
+    }
+    printf("%-8s", typeName(type));
+    for (size_t bus = 0; bus < BUSES; bus++)
+    {
+      printf(" %12.1f", predicted[bus][type] / 1e3 / summary[type].count);
+    }
+    printf("\n");
+  }
+  printf("%-8s", "total us");
+  for (size_t bus = 0; bus < BUSES; bus++)
+  {
+    unsigned long long total = 0;
+    for (uint8_t type = 0; type <= TRACE_CLEAR; type++)
+    {
+      total += predicted[bus][type];
+    }
+    printf(" %12.0f", total / 1e3);
+  }
+  printf("\n%-8s", "max us");
+  for (size_t bus = 0; bus < BUSES; bus++)
+  {
+    printf(" %12.0f", predictedMax[bus] / 1e3);
+  }
+  printf("\n%-8s", "gap B");
+  for (size_t bus = 0; bus < BUSES; bus++)
+  {
+    printf(" %12u", breakEvenGap(buses[bus], prefixLen, stretch));
+  }
+  printf("\n%-8s", "merge us");
+  for (size_t bus = 0; bus < BUSES; bus++)
+  {
+    printf(" %12.1f", mergeSaved[bus] / 1e3);
+  }
+  printf("\n");
+  return 0;
+}
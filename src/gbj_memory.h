@@ -26,16 +26,124 @@
 #ifndef GBJ_MEMORY_H
 #define GBJ_MEMORY_H
 
+#include "gbj_memory_address.h"
+#include "gbj_memory_cipher.h"
+#include "gbj_memory_timing.h"
+#include "gbj_memory_trace.h"
 #include "gbj_twowire.h"
+#if defined(__AVR__)
+  #include <avr/sleep.h>
+#elif defined(ESP32)
+  #include <esp_sleep.h>
+#endif
+
+// Zero heap build defined by the application, e.g., by compiler option
+// -DGBJ_MEMORY_ZERO_HEAP. Variable length arrays in the library are then
+// compile errors. Heap usage of the whole firmware is checked by the linker
+// with options -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free.
+#if defined(GBJ_MEMORY_ZERO_HEAP)
+  #define GBJ_MEMORY_STATIC_BEGIN                                              \
+    _Pragma("GCC diagnostic push")                                             \
+      _Pragma("GCC diagnostic error \"-Wvla\"")
+  #define GBJ_MEMORY_STATIC_END _Pragma("GCC diagnostic pop")
+#else
+  #define GBJ_MEMORY_STATIC_BEGIN
+  #define GBJ_MEMORY_STATIC_END
+#endif
+
+// Length of the transmit buffer of the two-wire library of the platform
+#if defined(I2C_BUFFER_LENGTH)
+  #define GBJ_MEMORY_WIRE_BUFFER I2C_BUFFER_LENGTH
+#elif defined(BUFFER_LENGTH)
+  #define GBJ_MEMORY_WIRE_BUFFER BUFFER_LENGTH
+#else
+  #define GBJ_MEMORY_WIRE_BUFFER 32
+#endif
 
-class gbj_memory : public gbj_twowire
+GBJ_MEMORY_STATIC_BEGIN
+/*
+  The template parameter is the address policy encoding memory positions to
+  address prefixes, e.g., gbj_memory_address::AddressAt24c16. The default one
+  selects one or two address bytes at run time.
+*/
+template<class ADDRESS = gbj_memory_address::AddressSelectable>
+class gbj_memory_t : public gbj_twowire
 {
 public:
-  gbj_memory(ClockSpeeds clockSpeed = ClockSpeeds::CLOCK_100KHZ,
-             uint8_t pinSDA = 4,
-             uint8_t pinSCL = 5)
+  gbj_memory_t(ClockSpeeds clockSpeed = ClockSpeeds::CLOCK_100KHZ,
+               uint8_t pinSDA = 4,
+               uint8_t pinSCL = 5)
     : gbj_twowire(clockSpeed, pinSDA, pinSCL){};
 
+  // Length of the trailer of a sealed record with nonce and authentication tag
+  static const uint8_t SEALED_NONCE_LEN = 4;
+  static const uint8_t SEALED_OVERHEAD =
+    SEALED_NONCE_LEN + gbj_memory_cipher::TAG_LEN;
+  // Length of the stack chunk for filling and batch reads, which is the
+  // transmit buffer of the two-wire library of the platform
+  static const uint8_t FILL_BUFFER_LEN =
+    GBJ_MEMORY_WIRE_BUFFER < 0xFF ? GBJ_MEMORY_WIRE_BUFFER : 0xFF;
+  // Maximal gap of a batch read computed from the bus timing
+  static const uint8_t BATCH_GAP_AUTO = 0xFF;
+  // Software overhead of a bus transaction in microseconds
+  static const uint8_t TRANSACTION_OVERHEAD =
+    gbj_memory_timing::TRANSACTION_OVERHEAD;
+
+  // Request of a batch read
+  struct ReadRequest
+  {
+    // Logical memory position
+    uint16_t position;
+    // Pointer to the data buffer for placing read data
+    uint8_t *dataBuffer;
+    // Number of bytes to be read
+    uint16_t dataLen;
+  };
+
+  // Statistics of merging decisions of batch reads
+  struct Batch
+  {
+    // Number of read requests
+    uint32_t requests;
+    // Number of requests read without their own addressing
+    uint32_t merged;
+    // Number of addressed bus transactions
+    uint32_t addressed;
+    // Number of bytes read through and discarded
+    uint32_t overread;
+  };
+
+  // Statistics of page alignment of stored streams
+  struct Alignment
+  {
+    // Number of stored streams
+    uint32_t writes;
+    // Number of streams written by more page programs than their length needs
+    uint32_t straddled;
+    // Number of page programs caused by straddling
+    uint32_t extraPrograms;
+    // Number of page fragments combined in the page buffer
+    uint32_t combined;
+  };
+
+  // Handler putting microcontroller to sleep for time period in milliseconds
+  typedef void (*SleepHandler)(uint32_t duration);
+
+  // Counters for estimating energy consumption of memory operations
+  struct Energy
+  {
+    // Estimated time of bus transfers in microseconds
+    uint32_t busTime;
+    // Time of busy waiting for page write cycles in microseconds
+    uint32_t waitTime;
+    // Time of sleeping during page write cycles in microseconds
+    uint32_t sleepTime;
+    // Number of page write cycles
+    uint16_t writeCycles;
+    // Number of wake ups from sleeping
+    uint16_t wakeups;
+  };
+
   /*
     Initialize two-wire bus and parameters of the memory.
 
@@ -86,6 +194,13 @@ public:
     pages if needed.
     - If length of the stored byte stream spans over memory pages, the method
       executes more bus transmissions, each for corresponding memory page.
+    - A failed page transmission is repeated according to the retry policy set
+      by the method setRetry(), so that already written pages are not written
+      again. The number of successfully written bytes is provided by the method
+      getProgress() for resuming the storing after an unrecoverable error.
+    - If write combining is set by the method setWriteCombine(), fragments of
+      memory pages are held in the page buffer and combined with adjacent
+      fragments of following streams, so that a page is programmed once.
 
     PARAMETERS:
     position - Logical memory position where the storing should start.
@@ -109,22 +224,19 @@ public:
                                  uint8_t *dataBuffer,
                                  uint16_t dataLen)
   {
-    uint16_t realPosition = getPositionReal(position);
     if (checkPosition(position, dataLen))
     {
       return getLastResult();
     }
+    startOperation();
+    countAlignment(position, dataLen);
     while (dataLen)
     {
-      uint8_t pageLen = min(
-        dataLen, memoryStatus_.pageSize - position % memoryStatus_.pageSize);
-      if (busSendStreamPrefixed(dataBuffer,
-                                dataLen,
-                                false,
-                                reinterpret_cast<uint8_t *>(&realPosition),
-                                getPositionInBytes() ? 1 : 2,
-                                true,
-                                true))
+      uint16_t pageLen =
+        min(dataLen,
+            static_cast<uint16_t>(memoryStatus_.pageSize -
+                                  position % memoryStatus_.pageSize));
+      if (storeFragment(position, dataBuffer, pageLen))
       {
         return getLastResult();
       }
@@ -165,27 +277,31 @@ public:
                                     uint8_t *dataBuffer,
                                     uint16_t dataLen)
   {
-    uint16_t realPosition = getPositionReal(position);
     if (checkPosition(position, dataLen))
     {
       return getLastResult();
     }
-    setBusRepeat();
-    if (busSendStream(reinterpret_cast<uint8_t *>(&realPosition),
-                      getPositionInBytes() ? 1 : 2,
-                      true))
+    startOperation();
+    if (readBurst(position, dataBuffer, dataLen) == ResultCodes::SUCCESS)
     {
-      return getLastResult();
+      patchFragment(position, dataBuffer, dataLen);
     }
-    setBusStop();
-    return busReceive(reinterpret_cast<uint8_t *>(dataBuffer), dataLen);
+    return getLastResult();
   }
 
   /*
-    Fill consecutive positions in the memory with a value.
+    Fill consecutive positions in the memory with a value or a pattern.
 
     DESCRIPTION:
-    The method writes input byte to defined positions in the memory.
+    The method writes input byte or repeating multi-byte pattern to defined
+    positions in the memory. The first byte of the pattern is written to the
+    start position.
+    - The pattern is streamed page by page without any buffer for the entire
+      range. If the page buffer for write combining is set, every memory page
+      is assembled in it and programmed at once. Otherwise the constant stack
+      chunk of FILL_BUFFER_LEN bytes without the position prefix is used, so
+      that a page is programmed at once if it fits the transmit buffer of the
+      two-wire library.
 
     PARAMETERS:
     position - Logical memory position where the filling should start.
@@ -193,7 +309,8 @@ public:
       - Default value: none
       - Limited range: 0 ~ (getCapacityByte() - 1)
 
-    dataLen - Number of positions to be filled in memory.
+    dataLen - Number of positions to be filled in memory. It is limited to the
+    end of the memory.
       - Data type: non-negative integer
       - Default value: none
       - Limited range: 0 ~ 65535
@@ -204,25 +321,83 @@ public:
       - Default value: none
       - Limited range: 0 ~ 255
 
+    pattern - Pointer to the repeating pattern.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: address space
+
+    patternLen - Length of the pattern in bytes.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 1 ~ 65535
+
     RETURN: Result code
   */
   inline ResultCodes fill(uint16_t position,
                           uint16_t dataLen,
                           uint8_t fillValue)
+  {
+    return fill(position, dataLen, &fillValue, 1);
+  }
+  inline ResultCodes fill(uint16_t position,
+                          uint16_t dataLen,
+                          const uint8_t *pattern,
+                          uint16_t patternLen)
   {
     // Sanitize
-    dataLen = min(dataLen, getCapacityByte() - position);
+    if (position < getCapacityByte())
+    {
+      dataLen =
+        min(static_cast<uint32_t>(dataLen), getCapacityByte() - position);
+    }
     if (checkPosition(position, dataLen))
     {
       return getLastResult();
     }
-    // Store
-    uint8_t dataBuffer[dataLen];
-    for (uint8_t i = 0; i < dataLen; i++)
+    if (patternLen == 0)
+    {
+      return setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    startOperation();
+    countAlignment(position, dataLen);
+    uint8_t chunk[FILL_BUFFER_LEN];
+    uint8_t *buffer = chunk;
+    // The position prefix shares the transmit buffer with data
+    uint16_t bufferLen = FILL_BUFFER_LEN - getPrefixLen();
+    if (combine_.buffer != NULL)
+    {
+      // Pending fragment is written before its buffer is reused
+      if (flush())
+      {
+        return getLastResult();
+      }
+      buffer = combine_.buffer;
+      bufferLen = memoryStatus_.pageSize;
+    }
+    uint16_t patternIdx = 0;
+    while (dataLen)
     {
-      dataBuffer[i] = fillValue;
+      uint16_t chunkLen =
+        min(dataLen,
+            static_cast<uint16_t>(memoryStatus_.pageSize -
+                                  position % memoryStatus_.pageSize));
+      chunkLen = min(chunkLen, bufferLen);
+      for (uint16_t i = 0; i < chunkLen; i++)
+      {
+        buffer[i] = pattern[patternIdx++];
+        if (patternIdx == patternLen)
+        {
+          patternIdx = 0;
+        }
+      }
+      if (writePage(position, buffer, chunkLen))
+      {
+        return getLastResult();
+      }
+      dataLen -= chunkLen;
+      position += chunkLen;
     }
-    return storeStream(position, dataBuffer, dataLen);
+    return getLastResult();
   }
 
   /*
@@ -318,6 +493,154 @@ public:
       position, reinterpret_cast<uint8_t *>(dataBuffer), sizeof(T));
   }
 
+  /*
+    Initialize a region of records with copies of a prototype.
+
+    DESCRIPTION:
+    The method writes consecutive copies of a record, e.g., a header with
+    default values, to the memory at once instead of storing them one by one.
+    - The method is templated utilizing method fill() with the prototype as
+    the repeating pattern, so that copies are assembled to memory pages. With
+    the page buffer for write combining every memory page is programmed just
+    once, i.e., the region takes count / (records per page) page programs
+    instead of count ones.
+
+    PARAMETERS:
+    position - Logical memory position of the first record.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - 1)
+
+    count - Number of records.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 1 ~ 65535
+
+    prototype - Record written to all positions of the region.
+      - Data type: dynamic
+      - Default value: none
+      - Limited range: none
+
+    RETURN: Result code, ERROR_POSITION if the region exceeds the memory
+  */
+  template<class T>
+  inline ResultCodes fillPattern(uint16_t position,
+                                 uint16_t count,
+                                 const T &prototype)
+  {
+    uint32_t dataLen = static_cast<uint32_t>(count) * sizeof(T);
+    if (dataLen > 0xFFFF)
+    {
+      return setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    if (checkPosition(position, dataLen))
+    {
+      return getLastResult();
+    }
+    return fill(position,
+                dataLen,
+                reinterpret_cast<const uint8_t *>(&prototype),
+                sizeof(T));
+  }
+
+  /*
+    Modify a value stored in the memory.
+
+    DESCRIPTION:
+    Read-modify-write primitives for persistent counters and flags, which read
+    the stored value, modify it, and write it back only if it has changed.
+    - If the value is held in the page buffer for write combining, it is read
+      from RAM without any bus traffic and written back to RAM as well, so
+      that a hot counter is programmed to the memory just once per flush,
+      which is controlled by the method setFlushPolicy().
+    - The value should not straddle memory pages, so that it is written by one
+      page program.
+    - The method increment() adds the delta to the value, setBits() sets bits
+      of the mask, clearBits() clears bits of the mask, and compareAndSwap()
+      writes the desired value only if the stored one equals the expected one.
+
+    PARAMETERS:
+    position - Logical memory position of the value.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - 1)
+
+    value - Referenced variable for placing the new value.
+      - Data type: dynamic
+      - Default value: none
+      - Limited range: none
+
+    delta - Increment of the value, negative one decrements it.
+      - Data type: dynamic
+      - Default value: 1
+      - Limited range: none
+
+    mask - Bit mask of the same data type as the stored value.
+      - Data type: dynamic
+      - Default value: none
+      - Limited range: none
+
+    expected - Referenced expected value, which gets the stored one if they
+    differ.
+      - Data type: dynamic
+      - Default value: none
+      - Limited range: none
+
+    desired - Value written if the stored one is equal to the expected one.
+      - Data type: dynamic
+      - Default value: none
+      - Limited range: none
+
+    RETURN: Result code, ERROR_RCV_DATA if compareAndSwap() finds the stored
+    value different from the expected one
+  */
+  template<class T, class D = T>
+  inline ResultCodes increment(uint16_t position, T &value, D delta = 1)
+  {
+    T stored;
+    if (readValue(position, stored))
+    {
+      return getLastResult();
+    }
+    value = stored + delta;
+    return writeValue(position, stored, value);
+  }
+  template<class T>
+  inline ResultCodes setBits(uint16_t position, T mask)
+  {
+    T stored;
+    if (readValue(position, stored))
+    {
+      return getLastResult();
+    }
+    return writeValue(position, stored, static_cast<T>(stored | mask));
+  }
+  template<class T>
+  inline ResultCodes clearBits(uint16_t position, T mask)
+  {
+    T stored;
+    if (readValue(position, stored))
+    {
+      return getLastResult();
+    }
+    return writeValue(position, stored, static_cast<T>(stored & ~mask));
+  }
+  template<class T>
+  inline ResultCodes compareAndSwap(uint16_t position, T &expected, T desired)
+  {
+    T stored;
+    if (readValue(position, stored))
+    {
+      return getLastResult();
+    }
+    if (memcmp(&stored, &expected, sizeof(T)))
+    {
+      expected = stored;
+      return setLastResult(ResultCodes::ERROR_RCV_DATA);
+    }
+    return writeValue(position, stored, desired);
+  }
+
   /*
     Read current position
 
@@ -335,48 +658,1464 @@ public:
   inline ResultCodes retrieveCurrent(uint8_t &data)
   {
     uint8_t *dataBuffer = &data;
-    return busReceive(static_cast<uint8_t *>(dataBuffer), 1);
+    return retrieveCurrentStream(static_cast<uint8_t *>(dataBuffer), 1);
   }
 
-  // Setters
-  inline void setPositionInBytes() { memoryStatus_.positionInBytes = true; }
-  inline void setPositionInWords() { memoryStatus_.positionInBytes = false; }
+  /*
+    Retrieve byte stream from current position.
 
-  // Getters
-  inline uint32_t getCapacityByte() { return memoryStatus_.maxPosition + 1L; }
-  inline uint32_t getCapacityBit() { return getCapacityByte() << 3; }
-  inline uint32_t getCapacityKiByte() { return getCapacityByte() >> 10; }
-  inline uint32_t getCapacityKiBit() { return getCapacityKiByte() << 3; }
-  inline uint16_t getPageSize() { return memoryStatus_.pageSize; } // In bytes
-  inline uint16_t getPages() { return getCapacityByte() / getPageSize(); }
-  inline uint16_t getPositionReal(uint16_t logicalPosition)
+    DESCRIPTION:
+    The method reads data from the memory starting at recently accessed
+    position incremented by 1, i.e., it continues reading after the recent
+    transaction without addressing the memory. Thus it is the fastest way of
+    sequential reading.
+    - A pending fragment of write combining is flushed before reading. The
+      flush moves the address counter of the memory, so that the memory is
+      addressed at the position following the recent transaction instead.
+
+    PARAMETERS:
+    dataBuffer - Pointer to the byte data buffer for placing read data.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: address space
+
+    dataLen - Number of bytes to be retrieved from memory.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 1 ~ 65535
+
+    RETURN: Result code, ERROR_POSITION if a fragment is pending and the
+    position following the recent transaction is unknown or the data exceed
+    the memory from it
+  */
+  inline ResultCodes retrieveCurrentStream(uint8_t *dataBuffer,
+                                           uint16_t dataLen)
   {
-    return logicalPosition + memoryStatus_.minPosition;
+    if (combine_.pending)
+    {
+      uint16_t address = cursor_.address;
+      if (!cursor_.known)
+      {
+        return setLastResult(ResultCodes::ERROR_POSITION);
+      }
+      if (checkPosition(address, dataLen) || flush())
+      {
+        return getLastResult();
+      }
+      startOperation();
+      return readBurst(address, dataBuffer, dataLen);
+    }
+    startOperation();
+    return readCurrent(dataBuffer, dataLen);
   }
-  inline bool getPositionInBytes() { return memoryStatus_.positionInBytes; };
-  inline bool getPositionInWords() { return !getPositionInBytes(); };
 
-private:
-  struct MemoryStatus
+  /*
+    Set read cursor.
+
+    DESCRIPTION:
+    The method sets the logical position of the read cursor kept in RAM for
+    the method readNext(). The memory is addressed lazily at the first reading,
+    so that seeking itself causes no bus traffic.
+
+    PARAMETERS:
+    position - Logical memory position of the next read byte.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - 1)
+
+    RETURN: Result code
+  */
+  inline ResultCodes seek(uint16_t position)
   {
-    // Maximal available position in bytes
-    uint16_t maxPosition;
-    // Physical position for logical 0 position of memory
-    uint16_t minPosition;
-    // Size of the memory page in bytes
-    uint16_t pageSize;
-    // Flag about using position long just 1 byte, default Word (false)
-    bool positionInBytes;
-  } memoryStatus_;
-  inline ResultCodes checkPosition(uint16_t position, uint16_t dataLen)
+    if (checkPosition(position, 1))
+    {
+      return getLastResult();
+    }
+    cursor_.position = position;
+    return getLastResult();
+  }
+
+  /*
+    Read next bytes at the cursor.
+
+    DESCRIPTION:
+    The method reads data from the logical position of the read cursor and
+    moves the cursor after them.
+    - The memory is read at its current address without address prefix as long
+      as its address counter tracked by the library is at the cursor. Any
+      other transaction with the memory moving it causes addressing at the next
+      reading.
+    - The cursor wraps to the logical position 0 at the memory capacity, where
+      the memory is addressed again, because the address counter of the chip
+      wraps at its physical end.
+    - A pending fragment of write combining is flushed before reading.
+
+    PARAMETERS:
+    dataBuffer - Pointer to the byte data buffer for placing read data or
+    referenced variable for placing read data.
+      - Data type: non-negative integer or T
+      - Default value: none
+      - Limited range: address space
+
+    dataLen - Number of bytes to be retrieved from memory.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 1 ~ 65535
+
+    RETURN: Result code
+  */
+  inline ResultCodes readNext(uint8_t *dataBuffer, uint16_t dataLen)
   {
-    setLastResult();
-    if (dataLen == 0 || memoryStatus_.maxPosition < (position + dataLen))
+    if (flush())
     {
-      return setLastResult(ResultCodes::ERROR_POSITION);
+      return getLastResult();
+    }
+    startOperation();
+    while (dataLen)
+    {
+      uint16_t chunkLen = min(
+        static_cast<uint32_t>(dataLen), getCapacityByte() - cursor_.position);
+      bool synced = cursor_.known && cursor_.address == cursor_.position;
+      if (synced ? readCurrent(dataBuffer, chunkLen)
+                 : readBurst(cursor_.position, dataBuffer, chunkLen))
+      {
+        return getLastResult();
+      }
+      cursor_.position += chunkLen;
+      if (cursor_.position == getCapacityByte())
+      {
+        cursor_.position = 0;
+      }
+      dataBuffer += chunkLen;
+      dataLen -= chunkLen;
     }
     return getLastResult();
   }
-};
+  template<class T>
+  inline ResultCodes readNext(T &data)
+  {
+    return readNext(reinterpret_cast<uint8_t *>(&data), sizeof(data));
+  }
+
+  /*
+    Retrieve multiple byte streams in a batch.
+
+    DESCRIPTION:
+    The method reads independent streams from scattered positions of the
+    memory with as few addressing sequences as possible.
+    - Requests are sorted by position in place, so that their order in the
+      provided array changes.
+    - A request starting at most gap bytes after the end of the previous one
+      is merged with it, i.e., the bytes in between are read through and
+      discarded without addressing the memory.
+    - A run of merged requests fitting the stack chunk together with their
+      gaps is read to it in one bus transaction. A run continues at the current
+      address after the previous one if it starts at most gap bytes after it.
+    - The default gap is the break-even one provided by the method
+      getBatchGap(), at which reading through lasts as long as addressing.
+    - Overlapping requests are not merged. A single request longer than the
+      stack chunk is read directly to its buffer.
+    - Merging decisions are counted in statistics provided by the method
+      getBatch().
+    - Pending bytes of write combining are patched to read data.
+
+    PARAMETERS:
+    requests - Pointer to the array of read requests with logical memory
+    position, pointer to the data buffer, and number of bytes.
+      - Data type: ReadRequest
+      - Default value: none
+      - Limited range: address space
+
+    count - Number of requests in the array.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ 255
+
+    gap - Maximal number of bytes between merged requests.
+      - Data type: non-negative integer
+      - Default value: BATCH_GAP_AUTO
+      - Limited range: 0 ~ FILL_BUFFER_LEN
+
+    RETURN: Result code
+  */
+  inline ResultCodes retrieveBatch(ReadRequest *requests,
+                                   uint8_t count,
+                                   uint8_t gap = BATCH_GAP_AUTO)
+  {
+    if (count == 0)
+    {
+      return setLastResult();
+    }
+    gap = gap == BATCH_GAP_AUTO ? getBatchGap() : min(gap, FILL_BUFFER_LEN);
+    // Insertion sort by position
+    for (uint8_t i = 1; i < count; i++)
+    {
+      ReadRequest request = requests[i];
+      uint8_t j = i;
+      for (; j > 0 && requests[j - 1].position > request.position; j--)
+      {
+        requests[j] = requests[j - 1];
+      }
+      requests[j] = request;
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+      if (checkPosition(requests[i].position, requests[i].dataLen))
+      {
+        return getLastResult();
+      }
+    }
+    startOperation();
+    uint8_t scratch[FILL_BUFFER_LEN];
+    // Current address of the memory after the previous run
+    uint32_t runEnd = 0;
+    for (uint8_t i = 0; i < count;)
+    {
+      // Run of merged requests read in one bus transaction
+      uint16_t runStart = requests[i].position;
+      uint32_t end = static_cast<uint32_t>(runStart) + requests[i].dataLen;
+      uint32_t dataLen = requests[i].dataLen;
+      uint8_t next = i + 1;
+      for (; next < count; next++)
+      {
+        ReadRequest &request = requests[next];
+        uint32_t requestEnd =
+          static_cast<uint32_t>(request.position) + request.dataLen;
+        if (request.position < end || request.position - end > gap ||
+            requestEnd - runStart > FILL_BUFFER_LEN)
+        {
+          break;
+        }
+        end = requestEnd;
+        dataLen += request.dataLen;
+      }
+      // Run continuing at the current address after the previous one
+      bool current = i > 0 && runStart >= runEnd && runStart - runEnd <= gap &&
+                     (end - runEnd <= FILL_BUFFER_LEN ||
+                      (runStart == runEnd && next == i + 1));
+      uint16_t readStart = current ? runEnd : runStart;
+      uint16_t readLen = end - readStart;
+      batch_.requests += next - i;
+      batch_.merged += next - i - (current ? 0 : 1);
+      batch_.addressed += current ? 0 : 1;
+      batch_.overread += readLen - dataLen;
+      if (next == i + 1 && readStart == runStart)
+      {
+        // Single request is read directly to its buffer
+        current ? readCurrent(requests[i].dataBuffer, readLen)
+                : readBurst(readStart, requests[i].dataBuffer, readLen);
+      }
+      else if ((current ? readCurrent(scratch, readLen)
+                        : readBurst(readStart, scratch, readLen)) ==
+               ResultCodes::SUCCESS)
+      {
+        for (uint8_t j = i; j < next; j++)
+        {
+          memcpy(requests[j].dataBuffer,
+                 scratch + requests[j].position - readStart,
+                 requests[j].dataLen);
+        }
+      }
+      if (isError())
+      {
+        return getLastResult();
+      }
+      runEnd = end;
+      for (; i < next; i++)
+      {
+        patchFragment(
+          requests[i].position, requests[i].dataBuffer, requests[i].dataLen);
+      }
+    }
+    return getLastResult();
+  }
+
+  /*
+    Write combined page fragment to the memory.
+
+    DESCRIPTION:
+    The method writes the pending fragment of a memory page held in the page
+    buffer set by the method setWriteCombine().
+    - The method should be called before powering down the microcontroller,
+      otherwise the pending fragment is lost.
+    - The fragment stays pending after a failed write, so that the flush can
+      be repeated. Bytes of the recent operation held in the page buffer are
+      added to its progress only after they have been written.
+
+    PARAMETERS: None
+
+    RETURN: Result code
+  */
+  inline ResultCodes flush()
+  {
+    setLastResult();
+    if (!combine_.pending)
+    {
+      return getLastResult();
+    }
+    uint16_t progress = retry_.progress;
+    if (writePage(combine_.page * memoryStatus_.pageSize + combine_.begin,
+                  combine_.buffer + combine_.begin,
+                  combine_.end - combine_.begin) == ResultCodes::SUCCESS)
+    {
+      combine_.pending = false;
+      progress += combine_.stored;
+      combine_.stored = 0;
+    }
+    retry_.progress = progress;
+    return getLastResult();
+  }
+
+  /*
+    Write combined page fragment to the memory if the flush policy is met.
+
+    DESCRIPTION:
+    The method writes the pending fragment of the page buffer, if it has been
+    updated at least the number of times or it has been pending at least the
+    time period set by the method setFlushPolicy(). The number of updates is
+    checked at every store as well, while the time period only here, so that
+    the method should be called periodically, e.g., in the loop() function.
+
+    PARAMETERS: None
+
+    RETURN: Result code
+  */
+  inline ResultCodes flushDue()
+  {
+    if (isFlushDue())
+    {
+      return flush();
+    }
+    return setLastResult();
+  }
+
+  /*
+    Align position of a record to memory pages.
+
+    DESCRIPTION:
+    The method is an allocation helper for laying out records in the memory,
+    which provides the nearest position not lower than the input one, at which
+    the record does not straddle more memory pages than necessary.
+    - A record not longer than a memory page is moved to the start of the next
+      page, if it would straddle the page boundary.
+    - A longer record is moved to the start of the next page, if it would
+      occupy more pages than its length needs.
+
+    PARAMETERS:
+    position - Logical memory position proposed for the record.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - 1)
+
+    dataLen - Length of the record in bytes.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ 65535
+
+    RETURN: Aligned logical memory position
+  */
+  inline uint16_t getPositionAligned(uint16_t position, uint16_t dataLen)
+  {
+    uint16_t offset = position % memoryStatus_.pageSize;
+    if (offset == 0 || dataLen == 0 ||
+        getPagesSpanned(position, dataLen) ==
+          (dataLen - 1) / memoryStatus_.pageSize + 1)
+    {
+      return position;
+    }
+    return position - offset + memoryStatus_.pageSize;
+  }
+
+  /*
+    Finish pending write cycle.
+
+    DESCRIPTION:
+    The method waits, in sleep mode if it is set, until the write cycle of the
+    recently stored memory page elapses.
+    - In the sleep write mode the write cycle of the last page of a stored
+      stream is not waited for at storing, but deferred to the next bus
+      transaction, so that a microcontroller can do useful work meanwhile.
+    - The method should be called before powering down the memory or the
+      microcontroller in order not to corrupt the last written page.
+
+    PARAMETERS: None
+
+    RETURN: None
+  */
+  inline void waitWriteCycle() { finishWriteCycle(); }
+
+  /*
+    Poll the memory for acknowledge.
+
+    DESCRIPTION:
+    The method repeatedly addresses the memory until it acknowledges, which
+    signals the end of its internal write cycle. It is the fastest way of
+    waiting for write cycle as well as way of measuring it, if the delay of the
+    parent library by its method setDelaySend() is set to zero.
+    - The method finishes a pending write cycle of the sleep write mode without
+      sleeping.
+
+    PARAMETERS:
+    timeout - Maximal time period of polling in milliseconds.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ 2^32 - 1
+
+    RETURN: Result code of the recent addressing
+  */
+  inline ResultCodes pollAck(uint32_t timeout)
+  {
+    uint16_t realPosition = getPositionReal(0);
+    uint8_t prefix[gbj_memory_address::PREFIX_MAX];
+    uint8_t address = selectDevice(encodePosition(0, prefix));
+    uint16_t polls = 0;
+    uint32_t timestamp = millis();
+    uint32_t timestampTrace = micros();
+    writeCycle_.pending = false;
+    do
+    {
+      polls++;
+      accountBus(getPrefixLen());
+      if (busSendStream(prefix, getPrefixLen(), false) == ResultCodes::SUCCESS)
+      {
+        break;
+      }
+    } while (millis() - timestamp < timeout);
+    restoreDevice(address);
+    // Acknowledged prefix sets the address counter
+    trackAddress(0, 0, isSuccess());
+    // Length of the polling record is the number of addressing attempts
+    traceTransaction(
+      gbj_memory_trace::TRACE_POLL, realPosition, polls, timestampTrace);
+    return getLastResult();
+  }
+
+  /*
+    Recover stuck two-wire bus.
+
+    DESCRIPTION:
+    The method releases the bus held by a slave device, which has been
+    interrupted in the middle of a transmission and keeps the data line low.
+    It disables the bus peripheral, generates up to 9 clock pulses until the
+    data line is released, generates stop condition, and initializes the bus
+    again.
+    - The bus lines are driven as open drain ones, i.e., a line is released
+      high by switching its pin to input and pulled low by output.
+    - On AVR platforms the hardware bus pins are used, on other platforms the
+      pins set in the constructor.
+
+    PARAMETERS: None
+
+    RETURN: Result code of the bus initialization
+  */
+  inline ResultCodes busClear()
+  {
+#if defined(__AVR__)
+    uint8_t pinSDA = SDA, pinSCL = SCL;
+#else
+    uint8_t pinSDA = getPinSDA(), pinSCL = getPinSCL();
+#endif
+    uint32_t timestamp = micros();
+#if !defined(ESP8266)
+    // Enabled peripheral overrides the port, e.g., TWEN on AVR
+    Wire.end();
+#endif
+    setLine(pinSDA, HIGH);
+    setLine(pinSCL, HIGH);
+    delayMicroseconds(5);
+    for (uint8_t i = 0; i < 9 && digitalRead(pinSDA) == LOW; i++)
+    {
+      setLine(pinSCL, LOW);
+      delayMicroseconds(5);
+      setLine(pinSCL, HIGH);
+      delayMicroseconds(5);
+    }
+    // Stop condition is rising data line at high clock line
+    setLine(pinSCL, LOW);
+    delayMicroseconds(5);
+    setLine(pinSDA, LOW);
+    delayMicroseconds(5);
+    setLine(pinSCL, HIGH);
+    delayMicroseconds(5);
+    setLine(pinSDA, HIGH);
+    delayMicroseconds(5);
+    gbj_twowire::begin();
+    trackAddress(0, 0, false);
+    traceTransaction(gbj_memory_trace::TRACE_CLEAR, 0, 0, timestamp);
+    return getLastResult();
+  }
+
+  /*
+    Send trace records from the ring buffer to a stream.
+
+    DESCRIPTION:
+    The method serializes trace records collected in the ring buffer set by the
+    method setTrace() from the oldest one to the stream, e.g., Serial, in the
+    format readable by the host trace analyzer.
+
+    PARAMETERS:
+    stream - Referenced stream for sending trace records.
+      - Data type: Print
+      - Default value: none
+      - Limited range: instance object
+
+    RETURN: Number of sent records
+  */
+  inline uint16_t dumpTrace(Print &stream)
+  {
+    if (trace_.buffer == NULL)
+    {
+      return 0;
+    }
+    uint16_t records =
+      min(trace_.count, static_cast<uint32_t>(trace_.bufferLen));
+    uint32_t index = trace_.count - records;
+    for (uint16_t i = 0; i < records; i++, index++)
+    {
+      uint8_t packed[gbj_memory_trace::TRACE_RECORD_LEN];
+      gbj_memory_trace::pack(trace_.buffer[index % trace_.bufferLen], packed);
+      stream.write(gbj_memory_trace::TRACE_SYNC,
+                   sizeof(gbj_memory_trace::TRACE_SYNC));
+      stream.write(packed, sizeof(packed));
+    }
+    return records;
+  }
+
+  /*
+    Sleep the microcontroller for a time period.
+
+    DESCRIPTION:
+    The method is default sleep handler for the sleep write mode. It puts the
+    microcontroller to the light sleep mode with timer wake up, if the platform
+    supports it, otherwise it just waits.
+    - On AVR platforms the idle sleep mode is used, from which the system timer
+      interrupt wakes the microcontroller every millisecond.
+    - On ESP32 platforms the light sleep mode with timer wake up is used.
+
+    PARAMETERS:
+    duration - Time period of sleeping in milliseconds.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ 2^32 - 1
+
+    RETURN: None
+  */
+  static void sleepDefault(uint32_t duration)
+  {
+#if defined(__AVR__)
+    uint32_t timestamp = millis();
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    while (millis() - timestamp < duration)
+    {
+      sleep_mode();
+    }
+#elif defined(ESP32)
+    esp_sleep_enable_timer_wakeup(duration * 1000ULL);
+    esp_light_sleep_start();
+#else
+    delay(duration);
+#endif
+  }
+
+  /*
+    Store byte stream to the memory sealed by authenticated encryption.
+
+    DESCRIPTION:
+    The method encrypts input data byte stream by the cipher ChaCha20-Poly1305
+    with the key set by the method setCipher() and writes it to the memory
+    chunked by memory pages followed by a trailer with the nonce and
+    authentication tag.
+    - The record occupies input data length plus SEALED_OVERHEAD bytes.
+    - The data is encrypted in place page by page right before its
+      transmission, so that no additional buffer is needed. After the call the
+      data buffer contains the cipher text.
+    - Every stored record gets a unique nonce from the sequence set by the
+      method setCipher(). The real memory position of the record is
+      authenticated as well, so that a record cannot be moved in the memory.
+
+    PARAMETERS:
+    position - Logical memory position where the storing should start.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - 1)
+
+    dataBuffer - Pointer to the byte data buffer.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: address space
+
+    dataLen - Number of bytes to be stored in memory.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ 65535
+
+    RETURN: Result code
+  */
+  inline ResultCodes storeSealedStream(uint16_t position,
+                                       uint8_t *dataBuffer,
+                                       uint16_t dataLen)
+  {
+    if (checkCipher() || checkPosition(position, dataLen + SEALED_OVERHEAD))
+    {
+      return getLastResult();
+    }
+    uint8_t trailer[SEALED_OVERHEAD];
+    for (uint8_t i = 0; i < SEALED_NONCE_LEN; i++)
+    {
+      trailer[i] = static_cast<uint8_t>(cipher_.sequence >> (8 * i));
+    }
+    cipher_.sequence++;
+    gbj_memory_cipher cipher;
+    startCipher(cipher, position, trailer);
+    startOperation();
+    while (dataLen)
+    {
+      uint16_t pageLen =
+        min(dataLen,
+            static_cast<uint16_t>(memoryStatus_.pageSize -
+                                  position % memoryStatus_.pageSize));
+      cipher.encrypt(dataBuffer, pageLen);
+      if (storeFragment(position, dataBuffer, pageLen))
+      {
+        return getLastResult();
+      }
+      dataLen -= pageLen;
+      dataBuffer += pageLen;
+      position += pageLen;
+    }
+    cipher.finish(trailer + SEALED_NONCE_LEN);
+    // Trailer can span over two memory pages
+    while (dataLen < SEALED_OVERHEAD)
+    {
+      uint16_t pageLen =
+        min(static_cast<uint16_t>(SEALED_OVERHEAD - dataLen),
+            static_cast<uint16_t>(memoryStatus_.pageSize -
+                                  position % memoryStatus_.pageSize));
+      if (storeFragment(position, trailer + dataLen, pageLen))
+      {
+        return getLastResult();
+      }
+      dataLen += pageLen;
+      position += pageLen;
+    }
+    return getLastResult();
+  }
+
+  /*
+    Retrieve byte stream sealed by authenticated encryption from the memory.
+
+    DESCRIPTION:
+    The method reads a record stored by the method storeSealedStream() in one
+    bus burst, decrypts it in place in the provided data buffer and verifies its
+    authentication tag.
+    - If the record has been modified or moved in the memory, or the key is
+      wrong, the method returns the error ERROR_RCV_DATA and zeroes the data
+      buffer.
+
+    PARAMETERS:
+    position - Logical memory position where the retrieving should start.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - 1)
+
+    dataBuffer - Pointer to the byte data buffer for placing decrypted data.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: address space
+
+    dataLen - Number of data bytes of the record, i.e., without the trailer.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ 65535
+
+    RETURN: Result code
+  */
+  inline ResultCodes retrieveSealedStream(uint16_t position,
+                                          uint8_t *dataBuffer,
+                                          uint16_t dataLen)
+  {
+    if (checkCipher() || checkPosition(position, dataLen + SEALED_OVERHEAD))
+    {
+      return getLastResult();
+    }
+    uint8_t trailer[SEALED_OVERHEAD];
+    // Trailer is read at current address, which cannot be patched
+    if (flush())
+    {
+      return getLastResult();
+    }
+    startOperation();
+    if (readBurst(position, dataBuffer, dataLen))
+    {
+      return getLastResult();
+    }
+    // Trailer follows the data at the current address of the memory
+    if (readCurrent(trailer, SEALED_OVERHEAD))
+    {
+      return getLastResult();
+    }
+    gbj_memory_cipher cipher;
+    startCipher(cipher, position, trailer);
+    cipher.decrypt(dataBuffer, dataLen);
+    if (!cipher.verify(trailer + SEALED_NONCE_LEN))
+    {
+      memset(dataBuffer, 0, dataLen);
+      return setLastResult(ResultCodes::ERROR_RCV_DATA);
+    }
+    return getLastResult();
+  }
+
+  /*
+    Store a value to memory sealed by authenticated encryption.
+
+    DESCRIPTION:
+    The method is templated utilizing method storeSealedStream(), so that it
+    determines data byte stream length automatically. The input value is
+    passed by value, so that its encryption in place does not affect the
+    caller.
+
+    PARAMETERS:
+    position - Logical memory position where the value storing should start.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - 1)
+
+    data - Value of particular data type that should be stored in the memory.
+      - Data type: dynamic
+      - Default value: none
+      - Limited range: 0 ~ getCapacityByte() - SEALED_OVERHEAD
+
+    RETURN: Result code
+  */
+  template<class T>
+  inline ResultCodes storeSealed(uint16_t position, T data)
+  {
+    return storeSealedStream(
+      position, static_cast<uint8_t *>(static_cast<void *>(&data)), sizeof(T));
+  }
+
+  /*
+    Retrieve a value sealed by authenticated encryption from the memory.
+
+    DESCRIPTION:
+    The method is templated utilizing method retrieveSealedStream(), so that it
+    determines data byte stream length automatically.
+
+    PARAMETERS:
+    position - Logical memory position where the value retrieving should start.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - 1)
+
+    data - Referenced variable for placing decrypted data of desired type.
+      - Data type: dynamic
+      - Default value: none
+      - Limited range: address space
+
+    RETURN: Result code
+  */
+  template<class T>
+  inline ResultCodes retrieveSealed(uint16_t position, T &data)
+  {
+    T *dataBuffer = &data;
+    return retrieveSealedStream(
+      position, reinterpret_cast<uint8_t *>(dataBuffer), sizeof(T));
+  }
+
+  // Setters
+  inline void setPositionInBytes()
+  {
+    static_assert(ADDRESS::SELECTABLE, "Address policy is fixed");
+    memoryStatus_.prefixLen = 1;
+  }
+  inline void setPositionInWords()
+  {
+    static_assert(ADDRESS::SELECTABLE, "Address policy is fixed");
+    memoryStatus_.prefixLen = 2;
+  }
+  inline void setWriteSleep(SleepHandler handler = sleepDefault)
+  {
+    writeCycle_.sleepHandler = handler;
+  }
+  inline void setWriteWait()
+  {
+    finishWriteCycle();
+    writeCycle_.sleepHandler = NULL;
+  }
+  inline void setEnergyModel(uint16_t voltage,
+                             uint16_t currentActive,
+                             uint16_t currentSleep)
+  {
+    energyModel_.voltage = voltage;
+    energyModel_.currentActive = currentActive;
+    energyModel_.currentSleep = currentSleep;
+  }
+  inline ResultCodes setWriteCombine(uint8_t *pageBuffer)
+  {
+    if (flush())
+    {
+      return getLastResult();
+    }
+    combine_.buffer = pageBuffer;
+    return getLastResult();
+  }
+  inline ResultCodes resetWriteCombine() { return setWriteCombine(NULL); }
+  inline void setFlushPolicy(uint16_t updates, uint32_t timeout = 0)
+  {
+    combine_.updatesMax = updates;
+    combine_.timeout = timeout;
+  }
+  inline void resetAlignment() { alignment_ = Alignment(); }
+  inline void resetBatch() { batch_ = Batch(); }
+  inline void setRetry(uint8_t attempts,
+                       uint16_t backoff = 1,
+                       bool busClear = true)
+  {
+    retry_.attempts = attempts;
+    retry_.backoff = backoff;
+    retry_.busClear = busClear;
+  }
+  inline void setTrace(gbj_memory_trace::TraceRecord *buffer,
+                       uint16_t bufferLen)
+  {
+    trace_.buffer = bufferLen ? buffer : NULL;
+    trace_.bufferLen = bufferLen;
+    trace_.count = 0;
+  }
+  inline void setTrace(Print &stream) { trace_.stream = &stream; }
+  inline void resetTrace()
+  {
+    trace_.buffer = NULL;
+    trace_.stream = NULL;
+  }
+  inline void setCipher(const uint8_t *key, uint32_t sequence)
+  {
+    cipher_.key = key;
+    cipher_.sequence = sequence;
+  }
+  inline void resetCipher() { cipher_.key = NULL; }
+  inline void resetEnergy()
+  {
+    energyLast_ = Energy();
+    energyTotal_ = Energy();
+  }
+
+  // Getters
+  inline uint32_t getCapacityByte() { return memoryStatus_.maxPosition + 1L; }
+  inline uint32_t getCapacityBit() { return getCapacityByte() << 3; }
+  inline uint32_t getCapacityKiByte() { return getCapacityByte() >> 10; }
+  inline uint32_t getCapacityKiBit() { return getCapacityKiByte() << 3; }
+  inline uint16_t getPageSize() { return memoryStatus_.pageSize; } // In bytes
+  inline uint16_t getPages() { return getCapacityByte() / getPageSize(); }
+  inline uint16_t getPositionReal(uint16_t logicalPosition)
+  {
+    return logicalPosition + memoryStatus_.minPosition;
+  }
+  inline bool getPositionInBytes() { return getPrefixLen() == 1; };
+  inline bool getPositionInWords() { return !getPositionInBytes(); };
+  inline bool getWriteCombine() { return combine_.buffer != NULL; }
+  inline bool getWritePending() { return combine_.pending; }
+  inline Alignment getAlignment() { return alignment_; }
+  inline Batch getBatch() { return batch_; }
+  // Gap in bytes, at which reading through lasts as long as addressing with
+  // prefix, repeated start, device address, and transaction overhead by the
+  // timing model at the bus clock
+  inline uint8_t getBatchGap()
+  {
+    uint16_t gap = gbj_memory_timing::breakEvenGap(
+      gbj_memory_timing::busTiming(getBusClock()),
+      getPrefixLen(),
+      0,
+      TRANSACTION_OVERHEAD);
+    return min(gap, static_cast<uint16_t>(FILL_BUFFER_LEN));
+  }
+  inline uint16_t getCursor() { return cursor_.position; }
+  inline uint8_t getRetryAttempts() { return retry_.attempts; }
+  inline uint32_t getRetries() { return retry_.retries; }
+  inline uint16_t getProgress() { return retry_.progress; }
+  inline uint32_t getTraceCount() { return trace_.count; }
+  inline bool getCipher() { return cipher_.key != NULL; }
+  inline uint32_t getCipherSequence() { return cipher_.sequence; }
+  inline bool getWriteSleep() { return writeCycle_.sleepHandler != NULL; }
+  // Deferred write cycle still in progress
+  inline bool getWriteBusy()
+  {
+    return writeCycle_.pending &&
+           millis() - writeCycle_.timestamp < writeCycle_.duration;
+  }
+  inline Energy getEnergyCountersLast() { return energyLast_; }
+  inline Energy getEnergyCountersTotal() { return energyTotal_; }
+  inline float getEnergyLast() { return getEnergy(energyLast_); } // In uJ
+  inline float getEnergyTotal() { return getEnergy(energyTotal_); } // In uJ
+
+private:
+  struct MemoryStatus
+  {
+    // Maximal available position in bytes
+    uint16_t maxPosition;
+    // Physical position for logical 0 position of memory
+    uint16_t minPosition;
+    // Size of the memory page in bytes
+    uint16_t pageSize;
+    // Length of the address prefix of the selectable address policy
+    uint8_t prefixLen;
+  } memoryStatus_ = { 0, 0, 0, ADDRESS::PREFIX_BYTES };
+  struct WriteCycle
+  {
+    // Sleep handler for sleep write mode, wait write mode if NULL
+    SleepHandler sleepHandler;
+    // Timestamp of the recent page write in milliseconds
+    uint32_t timestamp;
+    // Duration of the pending page write cycle in milliseconds
+    uint32_t duration;
+    // Flag about pending page write cycle
+    bool pending;
+  } writeCycle_ = { NULL, 0, 0, false };
+  struct EnergyModel
+  {
+    // Supply voltage in millivolts
+    uint16_t voltage;
+    // Current consumption of active microcontroller and memory in uA
+    uint16_t currentActive;
+    // Current consumption of sleeping microcontroller and memory in uA
+    uint16_t currentSleep;
+  } energyModel_ = { 3300, 5000, 1000 };
+  struct Cipher
+  {
+    // Pointer to the secret key of 32 bytes kept by the caller
+    const uint8_t *key;
+    // Nonce of the next sealed record
+    uint32_t sequence;
+  } cipher_ = { NULL, 0 };
+  struct Combine
+  {
+    // Page buffer provided by the caller, write combining disabled if NULL
+    uint8_t *buffer;
+    // Logical index of the buffered page
+    uint16_t page;
+    // Range of pending bytes in the page, end exclusive
+    uint16_t begin;
+    uint16_t end;
+    bool pending;
+    // Number of stores to the pending fragment and start of pending in ms
+    uint16_t updates;
+    uint32_t timestamp;
+    // Number of pending bytes stored by the recent operation
+    uint16_t stored;
+    // Flush policy, no limits if zero
+    uint16_t updatesMax;
+    uint32_t timeout;
+  } combine_ = { NULL, 0, 0, 0, false, 0, 0, 0, 0, 0 };
+  Alignment alignment_ = Alignment();
+  Batch batch_ = Batch();
+  struct Cursor
+  {
+    // Logical position of the next byte read by readNext()
+    uint16_t position;
+    // Logical position of the address counter of the memory
+    uint16_t address;
+    // Flag about the address counter known after the recent transaction
+    bool known;
+  } cursor_ = { 0, 0, false };
+  struct Retry
+  {
+    // Number of repeated attempts of a failed transaction
+    uint8_t attempts;
+    // Initial delay before repeated attempt in milliseconds, doubled each time
+    uint16_t backoff;
+    // Flag about clearing the bus before repeated attempt
+    bool busClear;
+    // Number of bytes transferred successfully by the recent operation
+    uint16_t progress;
+    // Number of repeated attempts since start
+    uint32_t retries;
+  } retry_ = { 0, 0, false, 0, 0 };
+  struct Trace
+  {
+    // Ring buffer of trace records provided by the caller
+    gbj_memory_trace::TraceRecord *buffer;
+    uint16_t bufferLen;
+    // Number of records written to the ring buffer since its setting
+    uint32_t count;
+    // Stream for sending serialized trace records
+    Print *stream;
+  } trace_ = { NULL, 0, 0, NULL };
+  Energy energyLast_ = Energy();
+  Energy energyTotal_ = Energy();
+
+  inline void startOperation()
+  {
+    energyLast_ = Energy();
+    retry_.progress = 0;
+    combine_.stored = 0;
+  }
+  inline ResultCodes checkCipher()
+  {
+    setLastResult();
+    if (cipher_.key == NULL)
+    {
+      return setLastResult(ResultCodes::ERROR_RCV_DATA);
+    }
+    return getLastResult();
+  }
+  // Start cipher for a sealed record with nonce from its trailer
+  inline void startCipher(gbj_memory_cipher &cipher,
+                          uint16_t position,
+                          const uint8_t *trailer)
+  {
+    uint8_t nonce[gbj_memory_cipher::NONCE_LEN] = { 0 };
+    uint16_t realPosition = getPositionReal(position);
+    uint8_t aad[2] = { static_cast<uint8_t>(realPosition),
+                       static_cast<uint8_t>(realPosition >> 8) };
+    memcpy(nonce, trailer, SEALED_NONCE_LEN);
+    cipher.begin(cipher_.key, nonce);
+    cipher.authenticate(aad, sizeof(aad));
+  }
+  // Length of the position prefix in bytes
+  inline uint8_t getPrefixLen()
+  {
+    return ADDRESS::SELECTABLE ? memoryStatus_.prefixLen
+                               : ADDRESS::PREFIX_BYTES;
+  }
+  // Encode real position to the prefix in sending order and return the device
+  // address of the transaction with folded high bits of the position
+  inline uint8_t encodePosition(uint16_t position, uint8_t *prefix)
+  {
+    return ADDRESS::encode(
+      static_cast<uint32_t>(position) + memoryStatus_.minPosition,
+      getPrefixLen(),
+      prefix,
+      getAddress());
+  }
+  // Switch to the device address of a transaction and return the base one
+  inline uint8_t selectDevice(uint8_t address)
+  {
+    uint8_t base = getAddress();
+    if (address != base)
+    {
+      setAddress(address);
+    }
+    return base;
+  }
+  // Restore the base device address after a transaction keeping its result
+  inline void restoreDevice(uint8_t address)
+  {
+    if (address != getAddress())
+    {
+      ResultCodes result = getLastResult();
+      setAddress(address);
+      setLastResult(result);
+    }
+  }
+  // Energy in microjoules
+  inline float getEnergy(const Energy &energy)
+  {
+    return 1e-9 * energyModel_.voltage *
+           (static_cast<float>(energyModel_.currentActive) *
+              (energy.busTime + energy.waitTime) +
+            static_cast<float>(energyModel_.currentSleep) * energy.sleepTime);
+  }
+  // Estimate bus transfer time of a transaction with provided data bytes
+  inline void accountBus(uint16_t dataLen)
+  {
+    // Device address byte, 9 clocks per byte, start and stop conditions.
+    // Clock in kHz keeps the product of the longest transfer within 32 bits.
+    uint32_t clocks = (dataLen + 1UL) * 9 + 2;
+    uint32_t busTime = clocks * 1000UL / (getBusClock() / 1000);
+    energyLast_.busTime += busTime;
+    energyTotal_.busTime += busTime;
+  }
+  inline void accountWriteCycle(uint32_t waitTime, uint32_t sleepTime)
+  {
+    energyLast_.writeCycles++;
+    energyLast_.waitTime += waitTime;
+    energyLast_.sleepTime += sleepTime;
+    energyTotal_.writeCycles++;
+    energyTotal_.waitTime += waitTime;
+    energyTotal_.sleepTime += sleepTime;
+    if (sleepTime)
+    {
+      energyLast_.wakeups++;
+      energyTotal_.wakeups++;
+    }
+  }
+  // Sleep off the remaining time of the pending write cycle
+  inline void finishWriteCycle()
+  {
+    if (!writeCycle_.pending)
+    {
+      return;
+    }
+    writeCycle_.pending = false;
+    uint32_t elapsed = millis() - writeCycle_.timestamp;
+    uint32_t remaining =
+      elapsed < writeCycle_.duration ? writeCycle_.duration - elapsed : 0;
+    if (remaining && writeCycle_.sleepHandler)
+    {
+      writeCycle_.sleepHandler(remaining);
+    }
+    accountWriteCycle(0, remaining * 1000UL);
+  }
+  inline uint16_t getPagesSpanned(uint16_t position, uint16_t dataLen)
+  {
+    return (position % memoryStatus_.pageSize + dataLen - 1) /
+             memoryStatus_.pageSize +
+           1;
+  }
+  inline void countAlignment(uint16_t position, uint16_t dataLen)
+  {
+    uint16_t pages = getPagesSpanned(position, dataLen);
+    uint16_t pagesMin = (dataLen - 1) / memoryStatus_.pageSize + 1;
+    alignment_.writes++;
+    if (pages > pagesMin)
+    {
+      alignment_.straddled++;
+      alignment_.extraPrograms += pages - pagesMin;
+    }
+  }
+  // Write data within one memory page, partial pages through the page buffer
+  inline ResultCodes storeFragment(uint16_t position,
+                                   uint8_t *dataBuffer,
+                                   uint16_t dataLen)
+  {
+    uint16_t page = position / memoryStatus_.pageSize;
+    uint16_t offset = position % memoryStatus_.pageSize;
+    bool samePage = combine_.pending && combine_.page == page;
+    if (combine_.buffer == NULL || dataLen == memoryStatus_.pageSize)
+    {
+      if (samePage && dataLen == memoryStatus_.pageSize)
+      {
+        // Pending fragment is superseded by entire page
+        combine_.pending = false;
+        combine_.stored = 0;
+      }
+      else if (samePage && flush())
+      {
+        return getLastResult();
+      }
+      return writePage(position, dataBuffer, dataLen);
+    }
+    // Only overlapping or adjacent fragments of the same page are combined
+    if (combine_.pending &&
+        (!samePage || offset > combine_.end ||
+         offset + dataLen < combine_.begin))
+    {
+      if (flush())
+      {
+        return getLastResult();
+      }
+    }
+    if (combine_.pending)
+    {
+      alignment_.combined++;
+      combine_.updates++;
+      combine_.begin = min(combine_.begin, offset);
+      combine_.end =
+        max(combine_.end, static_cast<uint16_t>(offset + dataLen));
+    }
+    else
+    {
+      combine_.page = page;
+      combine_.begin = offset;
+      combine_.end = offset + dataLen;
+      combine_.pending = true;
+      combine_.updates = 1;
+      combine_.timestamp = millis();
+    }
+    memcpy(combine_.buffer + offset, dataBuffer, dataLen);
+    combine_.stored += dataLen;
+    if ((combine_.begin == 0 && combine_.end == memoryStatus_.pageSize) ||
+        (combine_.updatesMax && combine_.updates >= combine_.updatesMax))
+    {
+      return flush();
+    }
+    return setLastResult();
+  }
+  inline bool isFlushDue()
+  {
+    if (!combine_.pending)
+    {
+      return false;
+    }
+    return (combine_.updatesMax && combine_.updates >= combine_.updatesMax) ||
+           (combine_.timeout &&
+            millis() - combine_.timestamp >= combine_.timeout);
+  }
+  // Read a value from the page buffer if it is entirely pending there
+  template<class T>
+  inline ResultCodes readValue(uint16_t position, T &value)
+  {
+    uint32_t pagePosition =
+      static_cast<uint32_t>(combine_.page) * memoryStatus_.pageSize;
+    if (combine_.pending && position >= pagePosition + combine_.begin &&
+        position + sizeof(T) <= pagePosition + combine_.end)
+    {
+      memcpy(&value, combine_.buffer + position - pagePosition, sizeof(T));
+      return setLastResult();
+    }
+    return retrieve(position, value);
+  }
+  // Write a modified value only if it differs from the stored one
+  template<class T>
+  inline ResultCodes writeValue(uint16_t position, const T &stored, T value)
+  {
+    if (memcmp(&stored, &value, sizeof(T)) == 0)
+    {
+      return setLastResult();
+    }
+    return store(position, value);
+  }
+  // Overwrite read data with pending bytes of the page buffer
+  inline void patchFragment(uint16_t position,
+                            uint8_t *dataBuffer,
+                            uint16_t dataLen)
+  {
+    if (!combine_.pending)
+    {
+      return;
+    }
+    uint16_t pagePosition = combine_.page * memoryStatus_.pageSize;
+    uint16_t begin = max(position, pagePosition + combine_.begin);
+    uint16_t end =
+      min(static_cast<uint32_t>(position) + dataLen,
+          static_cast<uint32_t>(pagePosition) + combine_.end);
+    if (begin < end)
+    {
+      memcpy(dataBuffer + begin - position,
+             combine_.buffer + begin - pagePosition,
+             end - begin);
+    }
+  }
+  // Write data within one memory page with retries
+  inline ResultCodes writePage(uint16_t position,
+                               uint8_t *dataBuffer,
+                               uint16_t dataLen)
+  {
+    for (uint8_t attempt = 0;; attempt++)
+    {
+      if (writePageOnce(position, dataBuffer, dataLen) ==
+            ResultCodes::SUCCESS ||
+          !recoverBus(attempt))
+      {
+        break;
+      }
+    }
+    if (isSuccess())
+    {
+      retry_.progress += dataLen;
+    }
+    return getLastResult();
+  }
+  // Read data from the memory in one burst with retries
+  inline ResultCodes readBurst(uint16_t position,
+                               uint8_t *dataBuffer,
+                               uint16_t dataLen)
+  {
+    for (uint8_t attempt = 0;; attempt++)
+    {
+      if (readBurstOnce(position, dataBuffer, dataLen) ==
+            ResultCodes::SUCCESS ||
+          !recoverBus(attempt))
+      {
+        break;
+      }
+    }
+    if (isSuccess())
+    {
+      retry_.progress += dataLen;
+    }
+    return getLastResult();
+  }
+  // Prepare another attempt of a failed transaction if the policy allows it
+  inline bool recoverBus(uint8_t attempt)
+  {
+    if (attempt >= retry_.attempts)
+    {
+      return false;
+    }
+    retry_.retries++;
+    if (retry_.busClear)
+    {
+      busClear();
+    }
+    // Exponential backoff
+    uint32_t backoff = static_cast<uint32_t>(retry_.backoff)
+                       << min(attempt, static_cast<uint8_t>(8));
+    if (writeCycle_.sleepHandler)
+    {
+      writeCycle_.sleepHandler(backoff);
+    }
+    else
+    {
+      delay(backoff);
+    }
+    return true;
+  }
+  // Write data within one memory page in one bus transaction
+  inline ResultCodes writePageOnce(uint16_t position,
+                                   uint8_t *dataBuffer,
+                                   uint16_t dataLen)
+  {
+    uint16_t realPosition = getPositionReal(position);
+    uint8_t prefix[gbj_memory_address::PREFIX_MAX];
+    finishWriteCycle();
+    uint8_t address = selectDevice(encodePosition(position, prefix));
+    accountBus(getPrefixLen() + dataLen);
+    uint32_t timestamp = micros();
+    if (writeCycle_.sleepHandler)
+    {
+      // Write cycle is handled here instead of busy waiting in the bus
+      writeCycle_.duration = getDelaySend();
+      setDelaySend(0);
+    }
+    busSendStreamPrefixed(dataBuffer,
+                          dataLen,
+                          false,
+                          prefix,
+                          getPrefixLen(),
+                          false,
+                          true);
+    restoreDevice(address);
+    // Address counter rolls over to the page start at the page end
+    trackAddress(position,
+                 dataLen,
+                 isSuccess() && (position + dataLen) % getPageSize());
+    traceTransaction(
+      gbj_memory_trace::TRACE_WRITE, realPosition, dataLen, timestamp);
+    if (writeCycle_.sleepHandler)
+    {
+      setDelaySend(writeCycle_.duration);
+      writeCycle_.timestamp = millis();
+      writeCycle_.pending = isSuccess();
+    }
+    else
+    {
+      accountWriteCycle(getDelaySend() * 1000UL, 0);
+    }
+    return getLastResult();
+  }
+  // Read data from the memory in one bus transaction
+  inline ResultCodes readBurstOnce(uint16_t position,
+                                   uint8_t *dataBuffer,
+                                   uint16_t dataLen)
+  {
+    uint16_t realPosition = getPositionReal(position);
+    uint8_t prefix[gbj_memory_address::PREFIX_MAX];
+    finishWriteCycle();
+    uint8_t address = selectDevice(encodePosition(position, prefix));
+    accountBus(getPrefixLen());
+    uint32_t timestamp = micros();
+    setBusRepeat();
+    if (busSendStream(prefix, getPrefixLen(), false) == ResultCodes::SUCCESS)
+    {
+      setBusStop();
+      accountBus(dataLen);
+      busReceive(dataBuffer, dataLen);
+    }
+    restoreDevice(address);
+    trackAddress(position, dataLen, isSuccess());
+    traceTransaction(
+      gbj_memory_trace::TRACE_READ, realPosition, dataLen, timestamp);
+    return getLastResult();
+  }
+  // Read data at the current address of the memory
+  inline ResultCodes readCurrent(uint8_t *dataBuffer, uint16_t dataLen)
+  {
+    uint8_t prefix[gbj_memory_address::PREFIX_MAX];
+    finishWriteCycle();
+    // Device address with folded bits of the tracked address counter
+    uint8_t address = selectDevice(
+      cursor_.known ? encodePosition(cursor_.address, prefix) : getAddress());
+    // Real position of the tracked address counter, zero if it is unknown
+    uint16_t realPosition =
+      cursor_.known ? getPositionReal(cursor_.address) : 0;
+    accountBus(dataLen);
+    uint32_t timestamp = micros();
+    if (busReceive(dataBuffer, dataLen) == ResultCodes::SUCCESS)
+    {
+      retry_.progress += dataLen;
+    }
+    restoreDevice(address);
+    trackAddress(cursor_.address, dataLen, cursor_.known && isSuccess());
+    traceTransaction(
+      gbj_memory_trace::TRACE_CURRENT, realPosition, dataLen, timestamp);
+    return getLastResult();
+  }
+  // Drive a bus line as open drain, released high or pulled low
+  inline void setLine(uint8_t pin, uint8_t level)
+  {
+    if (level == LOW)
+    {
+      digitalWrite(pin, LOW);
+      pinMode(pin, OUTPUT);
+    }
+    else
+    {
+      pinMode(pin, INPUT);
+    }
+  }
+  // Keep the address counter of the memory after a transaction at a position,
+  // which is unknown after a failure and at the end of the memory
+  inline void trackAddress(uint16_t position, uint16_t dataLen, bool known)
+  {
+    uint32_t address = static_cast<uint32_t>(position) + dataLen;
+    cursor_.address = address;
+    cursor_.known = known && address < getCapacityByte();
+  }
+  // Record a finished transaction to the trace
+  inline void traceTransaction(gbj_memory_trace::TraceTypes type,
+                               uint16_t realPosition,
+                               uint16_t dataLen,
+                               uint32_t timestamp)
+  {
+    if (trace_.buffer == NULL && trace_.stream == NULL)
+    {
+      return;
+    }
+    gbj_memory_trace::TraceRecord record;
+    record.timestamp = timestamp;
+    record.duration = min(micros() - timestamp, 0xFFFFUL);
+    record.position = realPosition;
+    record.length = dataLen;
+    record.type = type;
+    record.result = getLastResult();
+    if (trace_.buffer)
+    {
+      trace_.buffer[trace_.count++ % trace_.bufferLen] = record;
+    }
+    if (trace_.stream)
+    {
+      uint8_t packed[gbj_memory_trace::TRACE_RECORD_LEN];
+      gbj_memory_trace::pack(record, packed);
+      trace_.stream->write(gbj_memory_trace::TRACE_SYNC,
+                           sizeof(gbj_memory_trace::TRACE_SYNC));
+      trace_.stream->write(packed, sizeof(packed));
+    }
+  }
+  inline ResultCodes checkPosition(uint16_t position, uint16_t dataLen)
+  {
+    setLastResult();
+    if (dataLen == 0 ||
+        static_cast<uint32_t>(position) + dataLen > getCapacityByte())
+    {
+      return setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    return getLastResult();
+  }
+};
+template<class ADDRESS>
+const uint8_t gbj_memory_t<ADDRESS>::SEALED_NONCE_LEN;
+template<class ADDRESS>
+const uint8_t gbj_memory_t<ADDRESS>::SEALED_OVERHEAD;
+template<class ADDRESS>
+const uint8_t gbj_memory_t<ADDRESS>::FILL_BUFFER_LEN;
+template<class ADDRESS>
+const uint8_t gbj_memory_t<ADDRESS>::BATCH_GAP_AUTO;
+template<class ADDRESS>
+const uint8_t gbj_memory_t<ADDRESS>::TRANSACTION_OVERHEAD;
+
+// Memory with the address policy selectable at run time
+typedef gbj_memory_t<> gbj_memory;
+GBJ_MEMORY_STATIC_END
 
 #endif
@@ -0,0 +1,106 @@
+/*
+  NAME:
+  gbjMemoryAddress
+
+  DESCRIPTION:
+  Address policies encoding memory positions to address prefixes of two-wire
+  transactions for various memory geometries utilized by the library gbjMemory
+  as its template parameter.
+  - An encoder writes the lower bytes of a real memory position to the prefix
+    in the order of sending them to the bus and folds the higher bits to the
+    lowest bits of the device address of the transaction, e.g., for
+    AT24C04/08/16 with one address byte.
+  - Fixed encoders are instances of the template resolved at compile time, so
+    that the prefix length, byte order, and folding are constants without any
+    branching at run time.
+  - The selectable encoder is the default policy of the library, which keeps
+    the prefix length of one or two bytes set at run time by the methods
+    setPositionInBytes() and setPositionInWords().
+  - The header does not depend on Arduino framework, so that it can be
+    included in host applications as well.
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#ifndef GBJ_MEMORY_ADDRESS_H
+#define GBJ_MEMORY_ADDRESS_H
+
+#include <stdint.h>
+
+namespace gbj_memory_address
+{
+  // Maximal length of a prefix in bytes
+  const uint8_t PREFIX_MAX = 3;
+
+  /*
+    Fixed address encoder template.
+
+    PREFIX_LEN - Number of address bytes sent after the device address.
+    FOLD_BITS - Number of position bits above the prefix folded to the device
+    address.
+    LSB_FIRST - Flag about the least significant byte sent first, otherwise
+    the most significant byte is sent first as the usual memories expect.
+  */
+  template<uint8_t PREFIX_LEN, uint8_t FOLD_BITS = 0, bool LSB_FIRST = false>
+  struct Encoder
+  {
+    static_assert(PREFIX_LEN > 0 && PREFIX_LEN <= PREFIX_MAX,
+                  "Prefix must have 1 to 3 bytes");
+    static_assert(FOLD_BITS <= 3, "At most 3 bits can be folded");
+    static const bool SELECTABLE = false;
+    static const uint8_t PREFIX_BYTES = PREFIX_LEN;
+
+    // Write the prefix in sending order and return the device address of the
+    // transaction, the prefix length set at run time is ignored
+    static inline uint8_t encode(uint32_t position,
+                                 uint8_t,
+                                 uint8_t *prefix,
+                                 uint8_t address)
+    {
+      for (uint8_t i = 0; i < PREFIX_LEN; i++)
+      {
+        prefix[LSB_FIRST ? i : PREFIX_LEN - 1 - i] =
+          static_cast<uint8_t>(position >> (8 * i));
+      }
+      if (FOLD_BITS)
+      {
+        const uint8_t mask = (1 << FOLD_BITS) - 1;
+        address = (address & ~mask) |
+                  (static_cast<uint8_t>(position >> (8 * PREFIX_LEN)) & mask);
+      }
+      return address;
+    }
+  };
+
+  typedef Encoder<1> AddressByte; // Up to 256 B, e.g., AT24C01/02
+  typedef Encoder<2> AddressWord; // Up to 64 KiB, most significant byte first
+  typedef Encoder<2, 0, true> AddressWordLsb; // Least significant byte first
+  typedef Encoder<3> AddressTriple; // Three bytes, most significant first
+  typedef Encoder<1, 1> AddressAt24c04;
+  typedef Encoder<1, 2> AddressAt24c08;
+  typedef Encoder<1, 3> AddressAt24c16;
+
+  // Encoder of one or two bytes selected at run time, default two bytes
+  struct AddressSelectable
+  {
+    static const bool SELECTABLE = true;
+    static const uint8_t PREFIX_BYTES = 2;
+
+    static inline uint8_t encode(uint32_t position,
+                                 uint8_t prefixLen,
+                                 uint8_t *prefix,
+                                 uint8_t address)
+    {
+      return prefixLen == 1
+               ? AddressByte::encode(position, prefixLen, prefix, address)
+               : AddressWord::encode(position, prefixLen, prefix, address);
+    }
+  };
+}
+
+#endif
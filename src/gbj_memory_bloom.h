@@ -0,0 +1,250 @@
+/*
+  NAME:
+  gbjMemoryBloom
+
+  DESCRIPTION:
+  Bloom filter in RAM for keys of records stored in a memory managed by the
+  library gbjMemory, which answers most lookups of absent keys without any bus
+  traffic.
+  - The filter never rejects a key, which has been added to it. It can pass
+    an absent key with a false positive rate, which grows with the number of
+    added keys and is reported by the filter.
+  - The filter is built at start from stored keys, e.g., by iterating over a
+    pool or scanning an index, or it is loaded from a memory region, where it
+    has been persisted before.
+  - Keys are hashed by FNV-1a as byte sequences and bit positions are derived
+    by double hashing, so that the key type can be any plain data type.
+  - The template parameters are the size of the filter in bits, which should
+    fit the available RAM, and the number of hashes per key. The optimal number
+    of hashes is about 0.7 * BITS / (number of keys).
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#ifndef GBJ_MEMORY_BLOOM_H
+#define GBJ_MEMORY_BLOOM_H
+
+#include "gbj_memory.h"
+
+GBJ_MEMORY_STATIC_BEGIN
+template<uint16_t BITS, uint8_t HASHES = 4, class MEMORY = gbj_memory>
+class gbj_memory_bloom
+{
+public:
+  static_assert(BITS > 0 && HASHES > 0, "Filter must have bits and hashes");
+  typedef typename MEMORY::ResultCodes ResultCodes;
+
+  static const uint16_t BITMAP_LEN = (BITS + 7) / 8;
+
+  gbj_memory_bloom(MEMORY &memory)
+    : memory_(memory)
+  {
+    clear();
+  };
+
+  /*
+    Remove all keys.
+
+    PARAMETERS: None
+
+    RETURN: None
+  */
+  inline void clear()
+  {
+    memset(bitmap_, 0, BITMAP_LEN);
+    status_ = Status();
+  }
+
+  /*
+    Add a key to the filter.
+
+    DESCRIPTION:
+    The method sets bits of the key in RAM. It should be called for every key
+    stored in the memory, both while building the filter at start and at
+    storing a new record. Keys of removed records cannot be removed from the
+    filter, they just increase its false positive rate until it is rebuilt.
+
+    PARAMETERS:
+    key - Pointer to the key bytes or referenced key.
+      - Data type: non-negative integer or T
+      - Default value: none
+      - Limited range: address space
+
+    keyLen - Length of the key in bytes.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 1 ~ 65535
+
+    RETURN: None
+  */
+  inline void add(const uint8_t *key, uint16_t keyLen)
+  {
+    uint32_t h1, h2;
+    hash(key, keyLen, h1, h2);
+    for (uint8_t i = 0; i < HASHES; i++, h1 += h2)
+    {
+      uint16_t bit = h1 % BITS;
+      if (!(bitmap_[bit / 8] & (1 << (bit % 8))))
+      {
+        bitmap_[bit / 8] |= 1 << (bit % 8);
+        status_.bitsSet++;
+      }
+    }
+    status_.keys++;
+  }
+  template<class T>
+  inline void add(const T &key)
+  {
+    add(reinterpret_cast<const uint8_t *>(&key), sizeof(T));
+  }
+
+  /*
+    Test presence of a key.
+
+    DESCRIPTION:
+    The method tests bits of the key in RAM. If it returns false, the key is
+    surely absent in the memory and the lookup on the bus can be skipped.
+    If it returns true, the key is present with the probability given by
+    the false positive rate and the lookup has to be done.
+
+    PARAMETERS: The same as for the method add()
+
+    RETURN: Flag about possible presence of the key
+  */
+  inline bool mayContain(const uint8_t *key, uint16_t keyLen)
+  {
+    uint32_t h1, h2;
+    hash(key, keyLen, h1, h2);
+    status_.queries++;
+    for (uint8_t i = 0; i < HASHES; i++, h1 += h2)
+    {
+      uint16_t bit = h1 % BITS;
+      if (!(bitmap_[bit / 8] & (1 << (bit % 8))))
+      {
+        status_.rejects++;
+        return false;
+      }
+    }
+    return true;
+  }
+  template<class T>
+  inline bool mayContain(const T &key)
+  {
+    return mayContain(reinterpret_cast<const uint8_t *>(&key), sizeof(T));
+  }
+
+  /*
+    Persist or load the filter in a memory region.
+
+    DESCRIPTION:
+    The method store() writes a header with the filter configuration and
+    number of keys followed by the bitmap in page bursts. The method load()
+    reads them back in one burst, so that the filter need not be built from
+    stored keys at start. It should be rebuilt if it has not been persisted
+    after the last change of stored keys.
+
+    PARAMETERS:
+    position - Logical memory position of the region start.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - getRegionLen())
+
+    RETURN: Result code, ERROR_POSITION if the region does not contain a filter
+    with the same configuration, which is then cleared
+  */
+  inline ResultCodes store(uint16_t position)
+  {
+    Header header = { MAGIC, BITS, HASHES, status_.keys, status_.bitsSet };
+    if (memory_.store(position, header))
+    {
+      return memory_.getLastResult();
+    }
+    return memory_.storeStream(position + sizeof(Header), bitmap_, BITMAP_LEN);
+  }
+  inline ResultCodes load(uint16_t position)
+  {
+    Header header;
+    if (memory_.retrieve(position, header) ||
+        memory_.retrieveCurrentStream(bitmap_, BITMAP_LEN))
+    {
+      clear();
+      return memory_.getLastResult();
+    }
+    if (header.magic != MAGIC || header.bits != BITS ||
+        header.hashes != HASHES)
+    {
+      clear();
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    status_ = Status();
+    status_.keys = header.keys;
+    status_.bitsSet = header.bitsSet;
+    return memory_.getLastResult();
+  }
+
+  // Getters
+  inline uint16_t getKeys() { return status_.keys; }
+  inline uint16_t getBitsSet() { return status_.bitsSet; }
+  inline uint32_t getQueries() { return status_.queries; }
+  // Lookups answered in RAM without bus traffic
+  inline uint32_t getRejects() { return status_.rejects; }
+  // Probability of passing an absent key as the HASHES power of the fill ratio
+  inline float getFalsePositiveRate()
+  {
+    float fill = static_cast<float>(status_.bitsSet) / BITS;
+    float rate = 1.0;
+    for (uint8_t i = 0; i < HASHES; i++)
+    {
+      rate *= fill;
+    }
+    return rate;
+  }
+  inline uint16_t getRegionLen() { return sizeof(Header) + BITMAP_LEN; }
+
+private:
+  static const uint16_t MAGIC = 0xB10F;
+  MEMORY &memory_;
+  uint8_t bitmap_[BITMAP_LEN];
+  struct Header
+  {
+    uint16_t magic;
+    uint16_t bits;
+    uint8_t hashes;
+    uint16_t keys;
+    uint16_t bitsSet;
+  };
+  struct Status
+  {
+    // Number of added keys
+    uint16_t keys;
+    // Number of set bits of the bitmap
+    uint16_t bitsSet;
+    // Number of tested keys
+    uint32_t queries;
+    // Number of rejected keys
+    uint32_t rejects;
+  } status_;
+
+  // FNV-1a hash and its rotation as the second hash for double hashing
+  static inline void hash(const uint8_t *key,
+                          uint16_t keyLen,
+                          uint32_t &h1,
+                          uint32_t &h2)
+  {
+    h1 = 2166136261UL;
+    while (keyLen--)
+    {
+      h1 ^= *key++;
+      h1 *= 16777619UL;
+    }
+    h2 = ((h1 >> 17) | (h1 << 15)) | 1;
+  }
+};
+GBJ_MEMORY_STATIC_END
+
+#endif
@@ -0,0 +1,675 @@
+/*
+  NAME:
+  gbjMemoryBtree
+
+  DESCRIPTION:
+  Persistent sorted index B+tree in a region of a memory managed by the library
+  gbjMemory for large keyed datasets with ordered range scans.
+  - Every node occupies exactly one memory page, so that a node update is one
+    page program and a node read is one burst.
+  - The region starts with a header page followed by node pages allocated
+    sequentially.
+  - Leaves are linked to the right neighbor, so that a range scan reads
+    consecutive leaves without climbing the tree.
+  - Nodes of upper tree levels are kept in a small write-through RAM cache
+    with one line per level, so that the root and upper levels usually do not
+    cost any bus traffic, while leaves do not evict them.
+  - Removing a key does not rebalance the tree and nodes are never released.
+  - The template parameters are the key type with operator <, the value type,
+    the memory page size in bytes, and the number of cached tree levels.
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#ifndef GBJ_MEMORY_BTREE_H
+#define GBJ_MEMORY_BTREE_H
+
+#include "gbj_memory.h"
+
+GBJ_MEMORY_STATIC_BEGIN
+template<class K,
+         class V,
+         uint16_t PAGE,
+         uint8_t CACHE = 2,
+         class MEMORY = gbj_memory>
+class gbj_memory_btree
+{
+public:
+  typedef typename MEMORY::ResultCodes ResultCodes;
+
+  static const uint16_t NODE_NONE = 0xFFFF;
+  static const uint8_t HEIGHT_MAX = 8;
+  // Node header with leaf flag, number of keys and the right leaf link
+  static const uint8_t NODE_HEADER = 4;
+  static const uint8_t LEAF_KEYS =
+    (PAGE - NODE_HEADER) / (sizeof(K) + sizeof(V));
+  static const uint8_t INNER_KEYS = (PAGE - NODE_HEADER - 2) / (sizeof(K) + 2);
+  static_assert((PAGE - NODE_HEADER) / (sizeof(K) + sizeof(V)) >= 3 &&
+                  (PAGE - NODE_HEADER - 2) / (sizeof(K) + 2) >= 3,
+                "Page must hold at least 3 keys");
+  static_assert((PAGE - NODE_HEADER) / (sizeof(K) + sizeof(V)) <= 254 &&
+                  (PAGE - NODE_HEADER - 2) / (sizeof(K) + 2) <= 254,
+                "Page must hold at most 254 keys");
+
+  gbj_memory_btree(MEMORY &memory)
+    : memory_(memory){};
+
+  /*
+    Initialize tree in a memory region.
+
+    DESCRIPTION:
+    The method reads the header page of the tree. If it is not valid, the method
+    creates an empty tree with just root leaf.
+
+    PARAMETERS:
+    position - Logical memory position of the region start aligned to a memory
+    page.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - 1)
+
+    regionLen - Length of the region in bytes.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 3 * PAGE ~ getCapacityByte()
+
+    RETURN: Result code, ERROR_POSITION if the memory page size differs from
+    the template parameter or the region is not aligned or too short
+  */
+  inline ResultCodes begin(uint16_t position, uint16_t regionLen)
+  {
+    if (memory_.getPageSize() != PAGE || position % PAGE ||
+        regionLen < 3 * PAGE)
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    status_.position = position;
+    status_.nodesMax = regionLen / PAGE - 1;
+    invalidateCache();
+    if (memory_.retrieve(position, header_))
+    {
+      return memory_.getLastResult();
+    }
+    if (header_.magic != MAGIC || header_.nodes > status_.nodesMax ||
+        header_.root >= header_.nodes)
+    {
+      return format();
+    }
+    return memory_.getLastResult();
+  }
+
+  /*
+    Remove all keys.
+
+    DESCRIPTION:
+    The method creates an empty tree with just root leaf.
+
+    PARAMETERS: None
+
+    RETURN: Result code
+  */
+  inline ResultCodes format()
+  {
+    uint8_t node[PAGE];
+    memset(node, 0, PAGE);
+    setLeaf(node, true);
+    setNext(node, NODE_NONE);
+    header_.magic = MAGIC;
+    header_.root = 0;
+    header_.nodes = 1;
+    header_.height = 1;
+    if (writeNode(0, node))
+    {
+      return memory_.getLastResult();
+    }
+    return writeHeader();
+  }
+
+  /*
+    Find value of a key.
+
+    DESCRIPTION:
+    The method descends from the root to a leaf, which costs at most one page
+    read per tree level.
+
+    PARAMETERS:
+    key - Searched key.
+      - Data type: K
+      - Default value: none
+      - Limited range: none
+
+    value - Referenced variable for placing found value.
+      - Data type: V
+      - Default value: none
+      - Limited range: none
+
+    RETURN: Result code, ERROR_POSITION if the key is not present
+  */
+  inline ResultCodes find(const K &key, V &value)
+  {
+    uint8_t node[PAGE];
+    ResultCodes result = descend(key, node);
+    if (result)
+    {
+      return result;
+    }
+    uint8_t i = findLeaf(node, key);
+    if (i >= getCount(node) || !isEqual(getLeafKey(node, i), key))
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    value = getLeafValue(node, i);
+    return result;
+  }
+
+  /*
+    Insert a key or update its value.
+
+    DESCRIPTION:
+    The method writes the changed leaf in one page program. A full node is
+    split, which costs a page program for both halves, the parent, and the
+    header with the number of allocated nodes.
+    - Nodes for splitting all levels are reserved before the first write, so
+      that a full region fails without any change.
+    - At a bus failure the header in RAM is restored to the persisted one and
+      the unsplit leaf is written back. If an upper level has been written
+      already, the index should be rebuilt after format().
+
+    PARAMETERS:
+    key - Inserted key.
+      - Data type: K
+      - Default value: none
+      - Limited range: none
+
+    value - Value of the key.
+      - Data type: V
+      - Default value: none
+      - Limited range: none
+
+    RETURN: Result code, ERROR_POSITION if a full leaf should be split and the
+    region does not have free nodes for the tree height plus one
+  */
+  inline ResultCodes insert(const K &key, const V &value)
+  {
+    uint8_t node[PAGE];
+    ResultCodes result = descend(key, node);
+    if (result)
+    {
+      return result;
+    }
+    uint8_t count = getCount(node);
+    uint8_t pos = findLeaf(node, key);
+    if (pos < count && isEqual(getLeafKey(node, pos), key))
+    {
+      setLeafEntry(node, pos, key, value);
+      return writeNode(path_[header_.height - 1].node, node);
+    }
+    if (count < LEAF_KEYS)
+    {
+      for (uint8_t i = count; i > pos; i--)
+      {
+        setLeafEntry(
+          node, i, getLeafKey(node, i - 1), getLeafValue(node, i - 1));
+      }
+      setLeafEntry(node, pos, key, value);
+      setCount(node, count + 1);
+      return writeNode(path_[header_.height - 1].node, node);
+    }
+    return splitLeaf(node, pos, key, value);
+  }
+
+  /*
+    Remove a key.
+
+    DESCRIPTION:
+    The method removes the key from its leaf in one page program without
+    rebalancing the tree.
+
+    PARAMETERS:
+    key - Removed key.
+      - Data type: K
+      - Default value: none
+      - Limited range: none
+
+    RETURN: Result code, ERROR_POSITION if the key is not present
+  */
+  inline ResultCodes remove(const K &key)
+  {
+    uint8_t node[PAGE];
+    ResultCodes result = descend(key, node);
+    if (result)
+    {
+      return result;
+    }
+    uint8_t count = getCount(node);
+    uint8_t pos = findLeaf(node, key);
+    if (pos >= count || !isEqual(getLeafKey(node, pos), key))
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    for (uint8_t i = pos; i + 1 < count; i++)
+    {
+      setLeafEntry(
+        node, i, getLeafKey(node, i + 1), getLeafValue(node, i + 1));
+    }
+    setCount(node, count - 1);
+    return writeNode(path_[header_.height - 1].node, node);
+  }
+
+  /*
+    Iterate over a range of keys in ascending order.
+
+    DESCRIPTION:
+    The method descends to the leaf of the lower bound and then follows links
+    of leaves, so that every leaf of the range is read just once.
+
+    PARAMETERS:
+    keyFrom - Lower bound of the range, inclusive.
+      - Data type: K
+      - Default value: none
+      - Limited range: none
+
+    keyTo - Upper bound of the range, inclusive.
+      - Data type: K
+      - Default value: none
+      - Limited range: none
+
+    callback - Function or function object with signature
+    bool callback(const K &key, const V &value) returning false for stopping
+    the iteration.
+      - Data type: callable
+      - Default value: none
+      - Limited range: none
+
+    RETURN: Result code
+  */
+  template<class Callback>
+  inline ResultCodes scan(const K &keyFrom, const K &keyTo, Callback callback)
+  {
+    uint8_t node[PAGE];
+    ResultCodes result = descend(keyFrom, node);
+    if (result)
+    {
+      return result;
+    }
+    uint8_t i = findLeaf(node, keyFrom);
+    while (result == ResultCodes::SUCCESS)
+    {
+      for (; i < getCount(node); i++)
+      {
+        K key = getLeafKey(node, i);
+        if (keyTo < key || !callback(key, getLeafValue(node, i)))
+        {
+          return result;
+        }
+      }
+      uint16_t next = getNext(node);
+      if (next == NODE_NONE)
+      {
+        break;
+      }
+      result = readNode(next, node, header_.height - 1);
+      i = 0;
+    }
+    return result;
+  }
+
+  // Getters
+  inline uint8_t getHeight() { return header_.height; }
+  inline uint16_t getNodes() { return header_.nodes; }
+  inline uint16_t getNodesMax() { return status_.nodesMax; }
+  inline uint32_t getCacheHits() { return status_.cacheHits; }
+  inline uint32_t getCacheMisses() { return status_.cacheMisses; }
+
+private:
+  static const uint16_t MAGIC = 0xB7EE;
+  MEMORY &memory_;
+  struct Header
+  {
+    uint16_t magic;
+    uint16_t root;
+    uint16_t nodes;
+    uint8_t height;
+  } header_;
+  struct Status
+  {
+    uint16_t position;
+    uint16_t nodesMax;
+    uint32_t cacheHits;
+    uint32_t cacheMisses;
+  } status_ = { 0, 0, 0, 0 };
+  // Cache line of a tree level with its recently used node
+  struct CacheLine
+  {
+    uint16_t node;
+    uint8_t data[PAGE];
+  } cache_[CACHE];
+  // Nodes and child positions on the path from the root to a leaf
+  struct PathStep
+  {
+    uint16_t node;
+    uint8_t child;
+  } path_[HEIGHT_MAX];
+
+  // Node layout accessors, copying avoids unaligned access
+  static inline bool isLeaf(const uint8_t *node) { return node[0]; }
+  static inline void setLeaf(uint8_t *node, bool leaf) { node[0] = leaf; }
+  static inline uint8_t getCount(const uint8_t *node) { return node[1]; }
+  static inline void setCount(uint8_t *node, uint8_t count) { node[1] = count; }
+  static inline uint16_t getNext(const uint8_t *node)
+  {
+    return node[2] | node[3] << 8;
+  }
+  static inline void setNext(uint8_t *node, uint16_t next)
+  {
+    node[2] = static_cast<uint8_t>(next);
+    node[3] = static_cast<uint8_t>(next >> 8);
+  }
+  static inline K getLeafKey(const uint8_t *node, uint8_t i)
+  {
+    K key;
+    memcpy(&key, node + NODE_HEADER + i * (sizeof(K) + sizeof(V)), sizeof(K));
+    return key;
+  }
+  static inline V getLeafValue(const uint8_t *node, uint8_t i)
+  {
+    V value;
+    memcpy(&value,
+           node + NODE_HEADER + i * (sizeof(K) + sizeof(V)) + sizeof(K),
+           sizeof(V));
+    return value;
+  }
+  static inline void setLeafEntry(uint8_t *node,
+                                  uint8_t i,
+                                  const K &key,
+                                  const V &value)
+  {
+    uint8_t *entry = node + NODE_HEADER + i * (sizeof(K) + sizeof(V));
+    memcpy(entry, &key, sizeof(K));
+    memcpy(entry + sizeof(K), &value, sizeof(V));
+  }
+  static inline uint16_t getChild(const uint8_t *node, uint8_t i)
+  {
+    const uint8_t *child = node + NODE_HEADER + 2 * i;
+    return child[0] | child[1] << 8;
+  }
+  static inline void setChild(uint8_t *node, uint8_t i, uint16_t child)
+  {
+    node[NODE_HEADER + 2 * i] = static_cast<uint8_t>(child);
+    node[NODE_HEADER + 2 * i + 1] = static_cast<uint8_t>(child >> 8);
+  }
+  static inline K getInnerKey(const uint8_t *node, uint8_t i)
+  {
+    K key;
+    memcpy(&key,
+           node + NODE_HEADER + 2 * (INNER_KEYS + 1) + i * sizeof(K),
+           sizeof(K));
+    return key;
+  }
+  static inline void setInnerKey(uint8_t *node, uint8_t i, const K &key)
+  {
+    memcpy(node + NODE_HEADER + 2 * (INNER_KEYS + 1) + i * sizeof(K),
+           &key,
+           sizeof(K));
+  }
+  static inline bool isEqual(const K &a, const K &b)
+  {
+    return !(a < b) && !(b < a);
+  }
+  // Position of the first key not less than the searched one
+  static inline uint8_t findLeaf(const uint8_t *node, const K &key)
+  {
+    uint8_t i = 0;
+    while (i < getCount(node) && getLeafKey(node, i) < key)
+    {
+      i++;
+    }
+    return i;
+  }
+  // Child containing keys not less than separators before it
+  static inline uint8_t findChild(const uint8_t *node, const K &key)
+  {
+    uint8_t i = 0;
+    while (i < getCount(node) && !(key < getInnerKey(node, i)))
+    {
+      i++;
+    }
+    return i;
+  }
+
+  inline ResultCodes descend(const K &key, uint8_t *node)
+  {
+    uint16_t index = header_.root;
+    for (uint8_t level = 0; level < header_.height; level++)
+    {
+      ResultCodes result = readNode(index, node, level);
+      if (result)
+      {
+        return result;
+      }
+      path_[level].node = index;
+      if (isLeaf(node))
+      {
+        break;
+      }
+      path_[level].child = findChild(node, key);
+      index = getChild(node, path_[level].child);
+    }
+    return ResultCodes::SUCCESS;
+  }
+
+  inline ResultCodes splitLeaf(uint8_t *node,
+                               uint8_t pos,
+                               const K &key,
+                               const V &value)
+  {
+    // Reserve nodes for splitting every level up to a new root before any
+    // write, so that a split does not stop halfway for a full region
+    if (header_.nodes + header_.height + 1 > status_.nodesMax ||
+        header_.height >= HEIGHT_MAX)
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    Header saved = header_;
+    uint16_t leftIndex = path_[header_.height - 1].node;
+    uint8_t original[PAGE];
+    memcpy(original, node, PAGE);
+    uint8_t right[PAGE];
+    memset(right, 0, PAGE);
+    setLeaf(right, true);
+    uint16_t rightIndex = header_.nodes;
+    // Distribute LEAF_KEYS + 1 entries with the new one at its position
+    uint8_t total = LEAF_KEYS + 1;
+    uint8_t leftCount = total / 2 + total % 2;
+    for (uint8_t i = total; i-- > 0;)
+    {
+      K k;
+      V v;
+      if (i == pos)
+      {
+        k = key;
+        v = value;
+      }
+      else
+      {
+        uint8_t src = i > pos ? i - 1 : i;
+        k = getLeafKey(node, src);
+        v = getLeafValue(node, src);
+      }
+      if (i >= leftCount)
+      {
+        setLeafEntry(right, i - leftCount, k, v);
+      }
+      else
+      {
+        setLeafEntry(node, i, k, v);
+      }
+    }
+    setCount(node, leftCount);
+    setCount(right, total - leftCount);
+    setNext(right, getNext(node));
+    setNext(node, rightIndex);
+    // The new right node is written first, so that the left one does not link
+    // to an invalid node
+    header_.nodes++;
+    if (writeNode(rightIndex, right))
+    {
+      header_ = saved;
+      return memory_.getLastResult();
+    }
+    if (writeNode(leftIndex, node) == ResultCodes::SUCCESS &&
+        insertParent(header_.height - 1, getLeafKey(right, 0), rightIndex) ==
+          ResultCodes::SUCCESS)
+    {
+      return ResultCodes::SUCCESS;
+    }
+    // Roll back to the persisted header and the unsplit leaf keeping the error
+    ResultCodes result = memory_.getLastResult();
+    header_ = saved;
+    invalidateCache();
+    writeNode(leftIndex, original);
+    return memory_.setLastResult(result);
+  }
+
+  // Insert separator and right child to the parent of the node at the level
+  inline ResultCodes insertParent(uint8_t level, const K &key, uint16_t right)
+  {
+    uint8_t node[PAGE];
+    if (level == 0)
+    {
+      // New root above the split one in a node reserved by splitLeaf()
+      memset(node, 0, PAGE);
+      setCount(node, 1);
+      setChild(node, 0, header_.root);
+      setChild(node, 1, right);
+      setInnerKey(node, 0, key);
+      if (writeNode(header_.nodes, node))
+      {
+        return memory_.getLastResult();
+      }
+      header_.root = header_.nodes++;
+      header_.height++;
+      // Levels of all nodes have shifted
+      invalidateCache();
+      return writeHeader();
+    }
+    level--;
+    uint16_t index = path_[level].node;
+    uint8_t pos = path_[level].child;
+    ResultCodes result = readNode(index, node, level);
+    if (result)
+    {
+      return result;
+    }
+    uint8_t count = getCount(node);
+    if (count < INNER_KEYS)
+    {
+      for (uint8_t i = count; i > pos; i--)
+      {
+        setInnerKey(node, i, getInnerKey(node, i - 1));
+        setChild(node, i + 1, getChild(node, i));
+      }
+      setInnerKey(node, pos, key);
+      setChild(node, pos + 1, right);
+      setCount(node, count + 1);
+      if (writeNode(index, node))
+      {
+        return memory_.getLastResult();
+      }
+      return writeHeader();
+    }
+    // Split inner node into a node reserved by splitLeaf(), the middle key
+    // moves up
+    K keys[INNER_KEYS + 1];
+    uint16_t children[INNER_KEYS + 2];
+    for (uint8_t i = 0, j = 0; i <= INNER_KEYS; i++)
+    {
+      keys[i] = i == pos ? key : getInnerKey(node, j++);
+    }
+    for (uint8_t i = 0, j = 0; i <= INNER_KEYS + 1; i++)
+    {
+      children[i] = i == pos + 1 ? right : getChild(node, j++);
+    }
+    uint8_t mid = (INNER_KEYS + 1) / 2;
+    uint8_t sibling[PAGE];
+    memset(sibling, 0, PAGE);
+    setCount(node, mid);
+    for (uint8_t i = 0; i < mid; i++)
+    {
+      setInnerKey(node, i, keys[i]);
+      setChild(node, i, children[i]);
+    }
+    setChild(node, mid, children[mid]);
+    setCount(sibling, INNER_KEYS - mid);
+    for (uint8_t i = mid + 1; i <= INNER_KEYS; i++)
+    {
+      setInnerKey(sibling, i - mid - 1, keys[i]);
+      setChild(sibling, i - mid - 1, children[i]);
+    }
+    setChild(sibling, INNER_KEYS - mid, children[INNER_KEYS + 1]);
+    uint16_t siblingIndex = header_.nodes++;
+    if (writeNode(siblingIndex, sibling) || writeNode(index, node))
+    {
+      return memory_.getLastResult();
+    }
+    return insertParent(level, keys[mid], siblingIndex);
+  }
+
+  inline uint16_t getNodePosition(uint16_t index)
+  {
+    return status_.position + (index + 1) * PAGE;
+  }
+  inline ResultCodes writeHeader()
+  {
+    return memory_.store(status_.position, header_);
+  }
+  inline void invalidateCache()
+  {
+    for (uint8_t i = 0; i < CACHE; i++)
+    {
+      cache_[i].node = NODE_NONE;
+    }
+  }
+  inline ResultCodes readNode(uint16_t index, uint8_t *node, uint8_t level)
+  {
+    if (level < CACHE && cache_[level].node == index)
+    {
+      status_.cacheHits++;
+      memcpy(node, cache_[level].data, PAGE);
+      return memory_.setLastResult();
+    }
+    status_.cacheMisses++;
+    if (memory_.retrieveStream(getNodePosition(index), node, PAGE) ==
+          ResultCodes::SUCCESS &&
+        level < CACHE)
+    {
+      cache_[level].node = index;
+      memcpy(cache_[level].data, node, PAGE);
+    }
+    return memory_.getLastResult();
+  }
+  inline ResultCodes writeNode(uint16_t index, const uint8_t *node)
+  {
+    if (memory_.storeStream(
+          getNodePosition(index), const_cast<uint8_t *>(node), PAGE) ==
+        ResultCodes::SUCCESS)
+    {
+      for (uint8_t i = 0; i < CACHE; i++)
+      {
+        if (cache_[i].node == index)
+        {
+          memcpy(cache_[i].data, node, PAGE);
+        }
+      }
+    }
+    return memory_.getLastResult();
+  }
+};
+GBJ_MEMORY_STATIC_END
+
+#endif
@@ -0,0 +1,390 @@
+/*
+  NAME:
+  gbjMemoryCipher
+
+  DESCRIPTION:
+  Authenticated stream cipher ChaCha20-Poly1305 according to RFC 8439 for
+  encrypting data blocks stored in a memory.
+  - The cipher works in place on provided data buffer, so that it does not
+    need any other buffer than the internal state of 64 bytes.
+  - The class is utilized by the library gbjMemory for sealed records, but it
+    can be used standalone as well.
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#ifndef GBJ_MEMORY_CIPHER_H
+#define GBJ_MEMORY_CIPHER_H
+
+#include <stdint.h>
+#include <string.h>
+
+class gbj_memory_cipher
+{
+public:
+  static const uint8_t KEY_LEN = 32;
+  static const uint8_t NONCE_LEN = 12;
+  static const uint8_t TAG_LEN = 16;
+
+  /*
+    Initialize cipher for a message.
+
+    DESCRIPTION:
+    The method sets the key and nonce of the cipher and derives one-time
+    authentication key from the first key stream block.
+
+    PARAMETERS:
+    key - Pointer to the secret key of 32 bytes.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: address space
+
+    nonce - Pointer to the nonce of 12 bytes, which must never repeat for the
+    same key.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: address space
+
+    RETURN: None
+  */
+  inline void begin(const uint8_t *key, const uint8_t *nonce)
+  {
+    state_[0] = 0x61707865;
+    state_[1] = 0x3320646e;
+    state_[2] = 0x79622d32;
+    state_[3] = 0x6b206574;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+      state_[4 + i] = load32(key + 4 * i);
+    }
+    state_[12] = 0;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+      state_[13 + i] = load32(nonce + 4 * i);
+    }
+    // One-time Poly1305 key from the block 0
+    uint8_t block[64];
+    generateBlock(block);
+    polyBegin(block);
+    memset(block, 0, sizeof(block));
+    state_[12] = 1;
+    streamPos_ = 64;
+    aadLen_ = 0;
+    dataLen_ = 0;
+  }
+
+  /*
+    Authenticate additional data.
+
+    DESCRIPTION:
+    The method feeds not encrypted data, e.g., memory position, to the
+    authenticator. It should be called just once before encryption or
+    decryption.
+
+    PARAMETERS:
+    aad - Pointer to the additional data.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: address space
+
+    aadLen - Length of the additional data in bytes.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ 65535
+
+    RETURN: None
+  */
+  inline void authenticate(const uint8_t *aad, uint16_t aadLen)
+  {
+    polyUpdate(aad, aadLen);
+    polyPad();
+    aadLen_ = aadLen;
+  }
+
+  /*
+    Encrypt or decrypt data in place.
+
+    DESCRIPTION:
+    The method transforms data in place by the key stream and feeds the cipher
+    text to the authenticator. It can be called repeatedly for consecutive
+    chunks of a message.
+
+    PARAMETERS:
+    dataBuffer - Pointer to the data buffer.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: address space
+
+    dataLen - Length of the data in bytes.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ 65535
+
+    RETURN: None
+  */
+  inline void encrypt(uint8_t *dataBuffer, uint16_t dataLen)
+  {
+    crypt(dataBuffer, dataLen);
+    polyUpdate(dataBuffer, dataLen);
+  }
+  inline void decrypt(uint8_t *dataBuffer, uint16_t dataLen)
+  {
+    polyUpdate(dataBuffer, dataLen);
+    crypt(dataBuffer, dataLen);
+  }
+
+  /*
+    Finish the message and calculate authentication tag.
+
+    PARAMETERS:
+    tag - Pointer to the buffer of 16 bytes for the tag.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: address space
+
+    RETURN: None
+  */
+  inline void finish(uint8_t *tag)
+  {
+    polyPad();
+    uint8_t lengths[16];
+    store64(lengths, aadLen_);
+    store64(lengths + 8, dataLen_);
+    polyUpdate(lengths, sizeof(lengths));
+    polyFinish(tag);
+  }
+
+  /*
+    Verify authentication tag in constant time.
+
+    RETURN: Flag about matching tag
+  */
+  inline bool verify(const uint8_t *tag)
+  {
+    uint8_t calculated[TAG_LEN];
+    finish(calculated);
+    uint8_t diff = 0;
+    for (uint8_t i = 0; i < TAG_LEN; i++)
+    {
+      diff |= calculated[i] ^ tag[i];
+    }
+    return diff == 0;
+  }
+
+private:
+  // ChaCha20 state
+  uint32_t state_[16];
+  uint8_t stream_[64];
+  uint8_t streamPos_;
+  // Poly1305 state in 26-bit limbs
+  uint32_t r_[5], h_[5], pad_[4];
+  uint8_t polyBuffer_[16];
+  uint8_t polyBufferLen_;
+  uint16_t aadLen_, dataLen_;
+
+  static inline uint32_t load32(const uint8_t *p)
+  {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 |
+           static_cast<uint32_t>(p[3]) << 24;
+  }
+  static inline void store32(uint8_t *p, uint32_t v)
+  {
+    for (uint8_t i = 0; i < 4; i++, v >>= 8)
+    {
+      p[i] = static_cast<uint8_t>(v);
+    }
+  }
+  static inline void store64(uint8_t *p, uint32_t v)
+  {
+    store32(p, v);
+    store32(p + 4, 0);
+  }
+  static inline uint32_t rotl(uint32_t v, uint8_t n)
+  {
+    return (v << n) | (v >> (32 - n));
+  }
+  static inline void quarterRound(uint32_t *x, uint8_t a, uint8_t b, uint8_t c,
+                                  uint8_t d)
+  {
+    x[a] += x[b];
+    x[d] = rotl(x[d] ^ x[a], 16);
+    x[c] += x[d];
+    x[b] = rotl(x[b] ^ x[c], 12);
+    x[a] += x[b];
+    x[d] = rotl(x[d] ^ x[a], 8);
+    x[c] += x[d];
+    x[b] = rotl(x[b] ^ x[c], 7);
+  }
+  inline void generateBlock(uint8_t *block)
+  {
+    uint32_t x[16];
+    memcpy(x, state_, sizeof(x));
+    for (uint8_t i = 0; i < 10; i++)
+    {
+      quarterRound(x, 0, 4, 8, 12);
+      quarterRound(x, 1, 5, 9, 13);
+      quarterRound(x, 2, 6, 10, 14);
+      quarterRound(x, 3, 7, 11, 15);
+      quarterRound(x, 0, 5, 10, 15);
+      quarterRound(x, 1, 6, 11, 12);
+      quarterRound(x, 2, 7, 8, 13);
+      quarterRound(x, 3, 4, 9, 14);
+    }
+    for (uint8_t i = 0; i < 16; i++)
+    {
+      store32(block + 4 * i, x[i] + state_[i]);
+    }
+    state_[12]++;
+  }
+  inline void crypt(uint8_t *dataBuffer, uint16_t dataLen)
+  {
+    dataLen_ += dataLen;
+    while (dataLen--)
+    {
+      if (streamPos_ == 64)
+      {
+        generateBlock(stream_);
+        streamPos_ = 0;
+      }
+      *dataBuffer++ ^= stream_[streamPos_++];
+    }
+  }
+  inline void polyBegin(const uint8_t *key)
+  {
+    r_[0] = (load32(key + 0)) & 0x3ffffff;
+    r_[1] = (load32(key + 3) >> 2) & 0x3ffff03;
+    r_[2] = (load32(key + 6) >> 4) & 0x3ffc0ff;
+    r_[3] = (load32(key + 9) >> 6) & 0x3f03fff;
+    r_[4] = (load32(key + 12) >> 8) & 0x00fffff;
+    for (uint8_t i = 0; i < 5; i++)
+    {
+      h_[i] = 0;
+    }
+    for (uint8_t i = 0; i < 4; i++)
+    {
+      pad_[i] = load32(key + 16 + 4 * i);
+    }
+    polyBufferLen_ = 0;
+  }
+  inline void polyBlock(const uint8_t *m, uint32_t hibit)
+  {
+    uint32_t s1 = r_[1] * 5, s2 = r_[2] * 5, s3 = r_[3] * 5, s4 = r_[4] * 5;
+    h_[0] += (load32(m + 0)) & 0x3ffffff;
+    h_[1] += (load32(m + 3) >> 2) & 0x3ffffff;
+    h_[2] += (load32(m + 6) >> 4) & 0x3ffffff;
+    h_[3] += (load32(m + 9) >> 6) & 0x3ffffff;
+    h_[4] += (load32(m + 12) >> 8) | hibit;
+    uint64_t d[5];
+    d[0] = static_cast<uint64_t>(h_[0]) * r_[0] +
+           static_cast<uint64_t>(h_[1]) * s4 +
+           static_cast<uint64_t>(h_[2]) * s3 +
+           static_cast<uint64_t>(h_[3]) * s2 +
+           static_cast<uint64_t>(h_[4]) * s1;
+    d[1] = static_cast<uint64_t>(h_[0]) * r_[1] +
+           static_cast<uint64_t>(h_[1]) * r_[0] +
+           static_cast<uint64_t>(h_[2]) * s4 +
+           static_cast<uint64_t>(h_[3]) * s3 +
+           static_cast<uint64_t>(h_[4]) * s2;
+    d[2] = static_cast<uint64_t>(h_[0]) * r_[2] +
+           static_cast<uint64_t>(h_[1]) * r_[1] +
+           static_cast<uint64_t>(h_[2]) * r_[0] +
+           static_cast<uint64_t>(h_[3]) * s4 +
+           static_cast<uint64_t>(h_[4]) * s3;
+    d[3] = static_cast<uint64_t>(h_[0]) * r_[3] +
+           static_cast<uint64_t>(h_[1]) * r_[2] +
+           static_cast<uint64_t>(h_[2]) * r_[1] +
+           static_cast<uint64_t>(h_[3]) * r_[0] +
+           static_cast<uint64_t>(h_[4]) * s4;
+    d[4] = static_cast<uint64_t>(h_[0]) * r_[4] +
+           static_cast<uint64_t>(h_[1]) * r_[3] +
+           static_cast<uint64_t>(h_[2]) * r_[2] +
+           static_cast<uint64_t>(h_[3]) * r_[1] +
+           static_cast<uint64_t>(h_[4]) * r_[0];
+    uint32_t c = 0;
+    for (uint8_t i = 0; i < 5; i++)
+    {
+      d[i] += c;
+      c = static_cast<uint32_t>(d[i] >> 26);
+      h_[i] = static_cast<uint32_t>(d[i]) & 0x3ffffff;
+    }
+    h_[0] += c * 5;
+    c = h_[0] >> 26;
+    h_[0] &= 0x3ffffff;
+    h_[1] += c;
+  }
+  inline void polyUpdate(const uint8_t *m, uint16_t len)
+  {
+    while (len--)
+    {
+      polyBuffer_[polyBufferLen_++] = *m++;
+      if (polyBufferLen_ == 16)
+      {
+        polyBlock(polyBuffer_, 1UL << 24);
+        polyBufferLen_ = 0;
+      }
+    }
+  }
+  // Zero padding of authenticated data to the block boundary
+  inline void polyPad()
+  {
+    if (polyBufferLen_)
+    {
+      memset(polyBuffer_ + polyBufferLen_, 0, 16 - polyBufferLen_);
+      polyBlock(polyBuffer_, 1UL << 24);
+      polyBufferLen_ = 0;
+    }
+  }
+  inline void polyFinish(uint8_t *tag)
+  {
+    uint32_t c, g[5], mask;
+    // Full carry of h
+    c = h_[1] >> 26;
+    h_[1] &= 0x3ffffff;
+    for (uint8_t i = 2; i < 5; i++)
+    {
+      h_[i] += c;
+      c = h_[i] >> 26;
+      h_[i] &= 0x3ffffff;
+    }
+    h_[0] += c * 5;
+    c = h_[0] >> 26;
+    h_[0] &= 0x3ffffff;
+    h_[1] += c;
+    // Compute h - p and select it if h >= p
+    g[0] = h_[0] + 5;
+    c = g[0] >> 26;
+    g[0] &= 0x3ffffff;
+    for (uint8_t i = 1; i < 5; i++)
+    {
+      g[i] = h_[i] + c;
+      c = g[i] >> 26;
+      g[i] &= 0x3ffffff;
+    }
+    g[4] -= 1UL << 26;
+    mask = (g[4] >> 31) - 1;
+    for (uint8_t i = 0; i < 5; i++)
+    {
+      h_[i] = (h_[i] & ~mask) | (g[i] & mask);
+    }
+    // Serialize to 128 bits and add pad
+    uint32_t w[4];
+    w[0] = h_[0] | (h_[1] << 26);
+    w[1] = (h_[1] >> 6) | (h_[2] << 20);
+    w[2] = (h_[2] >> 12) | (h_[3] << 14);
+    w[3] = (h_[3] >> 18) | (h_[4] << 8);
+    uint64_t f = 0;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+      f = static_cast<uint64_t>(w[i]) + pad_[i] + (f >> 32);
+      store32(tag + 4 * i, static_cast<uint32_t>(f));
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,236 @@
+/*
+  NAME:
+  gbjMemoryCounter
+
+  DESCRIPTION:
+  Persistent monotonic counter with wear distribution in a region of a memory
+  managed by the library gbjMemory, e.g., boot or event counter.
+  - The region consists of slots with 4-byte values. An increment writes the
+    new value to the next slot in rotation, so that the slot of a value is the
+    value modulo the number of slots.
+  - Only the bytes of the slot, which differ from its previous value, are
+    written. Mostly it is just the lowest byte, so that an increment programs
+    one byte and every byte is programmed at most once per rotation. The
+    endurance of the counter is multiplied by the number of slots.
+  - The value is recovered at start as the maximal value of valid slots read
+    in bursts of a memory page. Slots not containing their
+    expected value, e.g., after an interrupted increment, are marked invalid
+    and written whole at their next increment.
+  - The template parameter is the number of slots.
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#ifndef GBJ_MEMORY_COUNTER_H
+#define GBJ_MEMORY_COUNTER_H
+
+#include "gbj_memory.h"
+
+GBJ_MEMORY_STATIC_BEGIN
+template<uint16_t SLOTS = 64, class MEMORY = gbj_memory>
+class gbj_memory_counter
+{
+public:
+  static_assert(SLOTS > 0, "Counter must have at least one slot");
+  typedef typename MEMORY::ResultCodes ResultCodes;
+
+  static const uint8_t SLOT_LEN = sizeof(uint32_t);
+  static const uint16_t BITMAP_LEN = (SLOTS + 7) / 8;
+  // Number of slots read in one burst at most, limited by the stack chunk
+  static const uint8_t CHUNK_SLOTS = MEMORY::FILL_BUFFER_LEN / SLOT_LEN;
+  // Value of an erased slot, which is never valid
+  static const uint32_t ERASED = 0xFFFFFFFF;
+
+  gbj_memory_counter(MEMORY &memory)
+    : memory_(memory)
+  {
+    memset(invalid_, 0, BITMAP_LEN);
+  };
+
+  /*
+    Initialize counter in a memory region.
+
+    DESCRIPTION:
+    The method reads all slots in bursts of a memory page and recovers the
+    value of the counter as the maximal value of valid slots. A slot is valid
+    if its value is zero or it is equal to the slot index modulo number of
+    slots, but it is not erased.
+    - In the second pass every slot, which does not contain its latest value
+      not above the counter, is marked invalid, e.g., a torn slot with correct
+      residue, so that it is written whole at its next increment.
+    - Invalid slots are counted, so that a torn slot does not prevent using
+      the counter.
+
+    PARAMETERS:
+    position - Logical memory position of the region start aligned to the
+    slot length, so that no slot straddles memory pages.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - getRegionLen())
+
+    RETURN: Result code, ERROR_POSITION if the position is not aligned
+  */
+  inline ResultCodes begin(uint16_t position)
+  {
+    if (position % SLOT_LEN)
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    position_ = position;
+    value_ = 0;
+    memset(invalid_, 0, BITMAP_LEN);
+    if (recoverSlots(false))
+    {
+      return memory_.getLastResult();
+    }
+    return recoverSlots(true);
+  }
+
+  /*
+    Reset counter to zero.
+
+    DESCRIPTION:
+    The method writes zero to all slots.
+
+    PARAMETERS: None
+
+    RETURN: Result code
+  */
+  inline ResultCodes format()
+  {
+    if (memory_.fill(position_, getRegionLen(), 0x00))
+    {
+      return memory_.getLastResult();
+    }
+    value_ = 0;
+    memset(invalid_, 0, BITMAP_LEN);
+    return memory_.getLastResult();
+  }
+
+  /*
+    Increment counter.
+
+    DESCRIPTION:
+    The method writes the incremented value to its slot. Only the range of
+    bytes differing from the previous value of the slot is written, an invalid
+    slot is written whole.
+
+    PARAMETERS: None
+
+    RETURN: Result code
+  */
+  inline ResultCodes increment()
+  {
+    uint32_t value = value_ + 1;
+    uint32_t previous = value >= SLOTS ? value - SLOTS : 0;
+    uint16_t slot = value % SLOTS;
+    // Range of changed bytes in little endian order
+    uint8_t first = 0, last = SLOT_LEN - 1;
+    while (!isInvalid(slot) && (value ^ previous) >> (8 * last) == 0)
+    {
+      last--;
+    }
+    while (!isInvalid(slot) && ((value ^ previous) >> (8 * first) & 0xFF) == 0)
+    {
+      first++;
+    }
+    uint8_t *buffer = reinterpret_cast<uint8_t *>(&value);
+    if (memory_.storeStream(position_ + slot * SLOT_LEN + first,
+                            buffer + first,
+                            last - first + 1))
+    {
+      return memory_.getLastResult();
+    }
+    setInvalid(slot, false);
+    value_ = value;
+    bytesWritten_ += last - first + 1;
+    return memory_.getLastResult();
+  }
+
+  // Getters
+  inline uint32_t getValue() { return value_; }
+  inline uint16_t getRegionLen() { return SLOTS * SLOT_LEN; }
+  // Written bytes since start, one per increment in the best case
+  inline uint32_t getBytesWritten() { return bytesWritten_; }
+  inline bool isInvalid(uint16_t slot)
+  {
+    return invalid_[slot / 8] & (1 << (slot % 8));
+  }
+  inline uint16_t getInvalidSlots()
+  {
+    uint16_t count = 0;
+    for (uint16_t slot = 0; slot < SLOTS; slot++)
+    {
+      count += isInvalid(slot);
+    }
+    return count;
+  }
+
+private:
+  MEMORY &memory_;
+  uint16_t position_ = 0;
+  uint32_t value_ = 0;
+  uint32_t bytesWritten_ = 0;
+  // Bitmap of slots found invalid at start and not written since then
+  uint8_t invalid_[BITMAP_LEN];
+
+  // Latest value of a slot not above the counter, zero if never written
+  inline uint32_t getExpected(uint16_t slot)
+  {
+    return value_ >= slot ? value_ - (value_ - slot) % SLOTS : 0;
+  }
+  // Read all slots in bursts of a memory page for the maximal value or for
+  // marking invalid slots
+  inline ResultCodes recoverSlots(bool mark)
+  {
+    uint32_t chunk[CHUNK_SLOTS];
+    uint16_t burst =
+      constrain(memory_.getPageSize() / SLOT_LEN,
+                1,
+                static_cast<uint16_t>(CHUNK_SLOTS));
+    for (uint16_t first = 0; first < SLOTS; first += burst)
+    {
+      uint16_t count = min(burst, static_cast<uint16_t>(SLOTS - first));
+      if (memory_.retrieveStream(position_ + first * SLOT_LEN,
+                                 reinterpret_cast<uint8_t *>(chunk),
+                                 count * SLOT_LEN))
+      {
+        return memory_.getLastResult();
+      }
+      for (uint16_t i = 0; i < count; i++)
+      {
+        uint16_t slot = first + i;
+        uint32_t slotValue = chunk[i];
+        if (mark)
+        {
+          setInvalid(slot, slotValue != getExpected(slot));
+        }
+        else if (slotValue != ERASED &&
+                 (!slotValue || slotValue % SLOTS == slot))
+        {
+          value_ = max(value_, slotValue);
+        }
+      }
+    }
+    return memory_.getLastResult();
+  }
+  inline void setInvalid(uint16_t slot, bool invalid)
+  {
+    if (invalid)
+    {
+      invalid_[slot / 8] |= 1 << (slot % 8);
+    }
+    else
+    {
+      invalid_[slot / 8] &= ~(1 << (slot % 8));
+    }
+  }
+};
+GBJ_MEMORY_STATIC_END
+
+#endif
@@ -0,0 +1,389 @@
+/*
+  NAME:
+  gbjMemoryPool
+
+  DESCRIPTION:
+  Persistent pool of fixed size records in a region of a memory managed by the
+  library gbjMemory, e.g., user profiles or RFID tags.
+  - The region starts with the occupancy bitmap with one bit per slot followed
+    by slots aligned to memory pages.
+  - Slots are packed to memory pages, so that no record straddles a page.
+  - The bitmap is cached in RAM and loaded in one burst at start, so that
+    finding a free slot does not need any bus traffic. Allocating or releasing
+    a slot writes just one byte of the bitmap.
+  - Iteration reads only pages with occupied slots. Each of them is addressed
+    once and read sequentially from the first to the last occupied slot.
+  - The template parameters are the type of a record and the number of slots.
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#ifndef GBJ_MEMORY_POOL_H
+#define GBJ_MEMORY_POOL_H
+
+#include "gbj_memory.h"
+
+GBJ_MEMORY_STATIC_BEGIN
+template<class T, uint16_t N, class MEMORY = gbj_memory>
+class gbj_memory_pool
+{
+public:
+  static_assert(N > 0, "Pool must have at least one slot");
+  typedef typename MEMORY::ResultCodes ResultCodes;
+
+  static const uint16_t SLOT_NONE = 0xFFFF;
+  static const uint16_t BITMAP_LEN = (N + 7) / 8;
+
+  gbj_memory_pool(MEMORY &memory)
+    : memory_(memory){};
+
+  /*
+    Initialize pool in a memory region.
+
+    DESCRIPTION:
+    The method calculates the layout of the pool in the memory region and loads
+    the occupancy bitmap to RAM.
+
+    PARAMETERS:
+    position - Logical memory position of the region start.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - 1)
+
+    RETURN: Result code, ERROR_POSITION if the record is longer than a memory
+    page or the pool does not fit to the memory
+  */
+  inline ResultCodes begin(uint16_t position)
+  {
+    uint16_t pageSize = memory_.getPageSize();
+    if (sizeof(T) > pageSize)
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    status_.bitmapPosition = position;
+    status_.slotsPerPage = pageSize / sizeof(T);
+    // Slots start at the page boundary following the bitmap
+    status_.slotsPosition =
+      (position + BITMAP_LEN + pageSize - 1) / pageSize * pageSize;
+    if (static_cast<uint32_t>(status_.slotsPosition) +
+          (N + status_.slotsPerPage - 1) / status_.slotsPerPage * pageSize >
+        memory_.getCapacityByte())
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    if (memory_.retrieveStream(position, bitmap_, BITMAP_LEN))
+    {
+      return memory_.getLastResult();
+    }
+    // Unused bits of the last byte are never free
+    for (uint16_t slot = N; slot < BITMAP_LEN * 8; slot++)
+    {
+      bitmap_[slot / 8] |= 1 << (slot % 8);
+    }
+    status_.used = 0;
+    status_.freeHint = 0;
+    for (uint16_t slot = 0; slot < N; slot++)
+    {
+      status_.used += isUsed(slot);
+    }
+    return memory_.getLastResult();
+  }
+
+  /*
+    Release all slots.
+
+    DESCRIPTION:
+    The method clears the entire occupancy bitmap in the memory. Records
+    themselves are not erased.
+
+    PARAMETERS: None
+
+    RETURN: Result code
+  */
+  inline ResultCodes format()
+  {
+    memset(bitmap_, 0, BITMAP_LEN);
+    if (memory_.storeStream(status_.bitmapPosition, bitmap_, BITMAP_LEN))
+    {
+      return memory_.getLastResult();
+    }
+    status_.used = 0;
+    status_.freeHint = 0;
+    return begin(status_.bitmapPosition);
+  }
+
+  /*
+    Store a record to a free slot.
+
+    DESCRIPTION:
+    The method finds a free slot, writes the record to it and only then marks
+    the slot as occupied, so that an interrupted adding does not leave an
+    occupied slot with invalid record.
+
+    PARAMETERS:
+    record - Referenced record to be stored.
+      - Data type: T
+      - Default value: none
+      - Limited range: none
+
+    slot - Referenced variable for placing the index of the used slot.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ N - 1, SLOT_NONE at failure
+
+    RETURN: Result code, ERROR_POSITION if the pool is full
+  */
+  inline ResultCodes add(const T &record, uint16_t &slot)
+  {
+    slot = findFree();
+    if (slot == SLOT_NONE)
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    if (store(slot, record) || markSlot(slot, true))
+    {
+      slot = SLOT_NONE;
+    }
+    return memory_.getLastResult();
+  }
+
+  /*
+    Allocate a free slot.
+
+    DESCRIPTION:
+    The method finds a free slot in the bitmap cached in RAM and marks it as
+    occupied. The search starts at the lowest slot, which can be free, and
+    skips fully occupied bitmap bytes.
+
+    PARAMETERS:
+    slot - Referenced variable for placing the index of the allocated slot.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ N - 1, SLOT_NONE at failure
+
+    RETURN: Result code, ERROR_POSITION if the pool is full
+  */
+  inline ResultCodes allocate(uint16_t &slot)
+  {
+    slot = findFree();
+    if (slot == SLOT_NONE)
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    if (markSlot(slot, true))
+    {
+      slot = SLOT_NONE;
+    }
+    return memory_.getLastResult();
+  }
+
+  /*
+    Release an occupied slot.
+
+    PARAMETERS:
+    slot - Index of the slot.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ N - 1
+
+    RETURN: Result code, ERROR_POSITION if the slot is not occupied
+  */
+  inline ResultCodes release(uint16_t slot)
+  {
+    if (!isUsed(slot))
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    return markSlot(slot, false);
+  }
+
+  /*
+    Write or read a record of a slot.
+
+    PARAMETERS:
+    slot - Index of the slot.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ N - 1
+
+    record - Referenced record.
+      - Data type: T
+      - Default value: none
+      - Limited range: none
+
+    RETURN: Result code, ERROR_POSITION if the slot is out of range
+  */
+  inline ResultCodes store(uint16_t slot, const T &record)
+  {
+    if (slot >= N)
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    return memory_.store(getSlotPosition(slot), record);
+  }
+  inline ResultCodes retrieve(uint16_t slot, T &record)
+  {
+    if (slot >= N)
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    return memory_.retrieve(getSlotPosition(slot), record);
+  }
+
+  /*
+    Iterate over occupied slots.
+
+    DESCRIPTION:
+    The method reads records of all occupied slots and passes them to the
+    callback. Pages without occupied slots are skipped. A page with occupied
+    slots is addressed just once and its slots up to the last occupied one are
+    read sequentially at the current memory address by the read cursor.
+    - The method moves the read cursor of the memory. The callback may access
+      the memory, which just causes addressing of the next slot.
+
+    PARAMETERS:
+    callback - Function or function object with signature
+    bool callback(uint16_t slot, T &record) returning false for stopping the
+    iteration.
+      - Data type: callable
+      - Default value: none
+      - Limited range: none
+
+    RETURN: Result code
+  */
+  template<class Callback>
+  inline ResultCodes forEach(Callback callback)
+  {
+    T record;
+    for (uint16_t first = 0; first < N; first += status_.slotsPerPage)
+    {
+      uint16_t last = min(static_cast<uint16_t>(first + status_.slotsPerPage),
+                          N);
+      bool addressed = false;
+      for (uint16_t slot = first; slot < last; slot++)
+      {
+        // The cursor is set for every slot, so that the memory is addressed
+        // again only if the callback moved its address counter
+        uint16_t position = getSlotPosition(slot);
+        if (!isUsed(slot))
+        {
+          // Free slots between occupied ones are read through
+          if (addressed && hasUsed(slot + 1, last) &&
+              (memory_.seek(position) || memory_.readNext(record)))
+          {
+            return memory_.getLastResult();
+          }
+          continue;
+        }
+        addressed = true;
+        if (memory_.seek(position) || memory_.readNext(record))
+        {
+          return memory_.getLastResult();
+        }
+        if (!callback(slot, record))
+        {
+          return memory_.getLastResult();
+        }
+      }
+    }
+    return memory_.getLastResult();
+  }
+
+  // Getters
+  inline bool isUsed(uint16_t slot)
+  {
+    return slot < N && (bitmap_[slot / 8] & (1 << (slot % 8)));
+  }
+  inline uint16_t getUsed() { return status_.used; }
+  inline uint16_t getFree() { return N - status_.used; }
+  inline uint16_t getSlotPosition(uint16_t slot)
+  {
+    return status_.slotsPosition +
+           slot / status_.slotsPerPage * memory_.getPageSize() +
+           slot % status_.slotsPerPage * sizeof(T);
+  }
+  // Length of the region from its start to the end of the last slot
+  inline uint16_t getRegionLen()
+  {
+    return getSlotPosition(N - 1) + sizeof(T) - status_.bitmapPosition;
+  }
+
+private:
+  MEMORY &memory_;
+  uint8_t bitmap_[BITMAP_LEN];
+  struct Status
+  {
+    uint16_t bitmapPosition;
+    uint16_t slotsPosition;
+    uint16_t slotsPerPage;
+    uint16_t used;
+    // Lowest slot, which can be free
+    uint16_t freeHint;
+  } status_;
+
+  inline uint16_t findFree()
+  {
+    for (uint16_t i = status_.freeHint / 8; i < BITMAP_LEN; i++)
+    {
+      if (bitmap_[i] != 0xFF)
+      {
+        uint8_t bit = 0;
+        while (bitmap_[i] & (1 << bit))
+        {
+          bit++;
+        }
+        status_.freeHint = i * 8 + bit;
+        return status_.freeHint;
+      }
+    }
+    status_.freeHint = N;
+    return SLOT_NONE;
+  }
+  inline bool hasUsed(uint16_t first, uint16_t last)
+  {
+    while (first < last)
+    {
+      if (isUsed(first++))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+  // Write changed bitmap byte of the slot
+  inline ResultCodes markSlot(uint16_t slot, bool used)
+  {
+    uint8_t bitmapByte = bitmap_[slot / 8];
+    if (used)
+    {
+      bitmapByte |= 1 << (slot % 8);
+    }
+    else
+    {
+      bitmapByte &= ~(1 << (slot % 8));
+    }
+    if (memory_.store(status_.bitmapPosition + slot / 8, bitmapByte))
+    {
+      return memory_.getLastResult();
+    }
+    bitmap_[slot / 8] = bitmapByte;
+    if (used)
+    {
+      status_.used++;
+    }
+    else
+    {
+      status_.used--;
+      status_.freeHint = min(status_.freeHint, slot);
+    }
+    return memory_.getLastResult();
+  }
+};
+GBJ_MEMORY_STATIC_END
+
+#endif
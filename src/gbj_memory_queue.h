@@ -0,0 +1,359 @@
+/*
+  NAME:
+  gbjMemoryQueue
+
+  DESCRIPTION:
+  Persistent byte FIFO queue in a region of a memory managed by the library
+  gbjMemory for store-and-forward buffering surviving reboots.
+  - The region is divided into a journal of head and tail pointers and a ring
+    buffer of data.
+  - Pointers are not rewritten at a fixed position. Every commit writes a new
+    sequence record to the next journal slot, so that wear of the journal is
+    spread over all its slots. At start the record with the highest valid
+    sequence is recovered.
+  - Enqueued data is written by memory pages in as few bus transactions as
+    possible and dequeued data is read in bursts.
+  - Enqueuing without commit is batched to whole memory pages by the write
+    combining of the memory, if its page buffer is set. The commit flushes the
+    batched data before the journal record, so that a committed tail never
+    points behind data not written yet.
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#ifndef GBJ_MEMORY_QUEUE_H
+#define GBJ_MEMORY_QUEUE_H
+
+#include "gbj_memory.h"
+
+GBJ_MEMORY_STATIC_BEGIN
+template<class MEMORY = gbj_memory>
+class gbj_memory_queue_t
+{
+public:
+  typedef typename MEMORY::ResultCodes ResultCodes;
+
+  // Length of a journal record in bytes
+  static const uint8_t JOURNAL_SLOT_LEN = 8;
+
+  gbj_memory_queue_t(MEMORY &memory)
+    : memory_(memory){};
+
+  /*
+    Initialize queue in a memory region.
+
+    DESCRIPTION:
+    The method divides the memory region into the journal and the data ring
+    buffer and recovers head and tail pointers from the journal.
+    - If the journal does not contain any valid record, the queue is empty.
+    - A region aligned to a memory page with the default journal keeps pages
+      of the ring buffer aligned to memory pages, so that batched enqueuing
+      programs every page once.
+
+    PARAMETERS:
+    position - Logical memory position of the region start aligned to the
+    journal record length, so that no record straddles memory pages.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - 1)
+
+    regionLen - Length of the entire region in bytes.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ getCapacityByte()
+
+    journalSlots - Number of journal records. More slots spread wear of the
+    pointers to more memory positions.
+      - Data type: non-negative integer
+      - Default value: memory page size divided by journal record length,
+        at least 2 and at most 255
+      - Limited range: 1 ~ 255
+
+    RETURN: Result code, ERROR_POSITION if the position is not aligned or the
+    region is not longer than the journal plus one byte
+  */
+  inline ResultCodes begin(uint16_t position,
+                           uint16_t regionLen,
+                           uint8_t journalSlots = 0)
+  {
+    if (journalSlots == 0)
+    {
+      journalSlots =
+        constrain(memory_.getPageSize() / JOURNAL_SLOT_LEN, 2, 255);
+    }
+    uint16_t journalLen = journalSlots * JOURNAL_SLOT_LEN;
+    if (position % JOURNAL_SLOT_LEN || regionLen <= journalLen + 1)
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    status_.journalPosition = position;
+    status_.journalSlots = journalSlots;
+    status_.dataPosition = position + journalLen;
+    status_.dataLen = regionLen - journalLen;
+    status_.head = status_.tail = 0;
+    status_.sequence = 0;
+    status_.slot = journalSlots - 1;
+    return recover();
+  }
+
+  /*
+    Put data to the queue.
+
+    DESCRIPTION:
+    The method writes data at the tail of the queue. Data wrapping over the end
+    of the ring buffer is written in two streams.
+    - The commit of pointers can be deferred in order to batch more enqueued
+      chunks to one journal record and to whole memory pages with write
+      combining. Uncommitted data is lost at reboot.
+
+    PARAMETERS:
+    dataBuffer - Pointer to the byte data buffer.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: address space
+
+    dataLen - Number of bytes to be enqueued.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ getFree()
+
+    commitFlag - Flag about committing pointers to the journal.
+      - Data type: boolean
+      - Default value: true
+      - Limited range: true, false
+
+    RETURN: Result code, ERROR_POSITION if data does not fit to the queue
+  */
+  inline ResultCodes enqueue(uint8_t *dataBuffer,
+                             uint16_t dataLen,
+                             bool commitFlag = true)
+  {
+    if (dataLen > getFree())
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    uint16_t chunkLen =
+      min(dataLen, static_cast<uint16_t>(status_.dataLen - status_.tail));
+    if (memory_.storeStream(
+          status_.dataPosition + status_.tail, dataBuffer, chunkLen))
+    {
+      return memory_.getLastResult();
+    }
+    if (dataLen > chunkLen &&
+        memory_.storeStream(
+          status_.dataPosition, dataBuffer + chunkLen, dataLen - chunkLen))
+    {
+      return memory_.getLastResult();
+    }
+    status_.tail = (status_.tail + dataLen) % status_.dataLen;
+    return commitFlag ? commit() : memory_.getLastResult();
+  }
+
+  /*
+    Get data from the queue.
+
+    DESCRIPTION:
+    The method reads data from the head of the queue in at most two bursts and
+    removes it from the queue.
+
+    PARAMETERS:
+    dataBuffer - Pointer to the byte data buffer for placing read data.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: address space
+
+    dataLen - Number of bytes to be dequeued.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ getUsed()
+
+    commitFlag - Flag about committing pointers to the journal.
+      - Data type: boolean
+      - Default value: true
+      - Limited range: true, false
+
+    RETURN: Result code, ERROR_POSITION if the queue has less data
+  */
+  inline ResultCodes dequeue(uint8_t *dataBuffer,
+                             uint16_t dataLen,
+                             bool commitFlag = true)
+  {
+    ResultCodes result = peek(dataBuffer, dataLen);
+    if (result)
+    {
+      return result;
+    }
+    return drop(dataLen, commitFlag);
+  }
+
+  /*
+    Read data from the queue without removing it.
+
+    PARAMETERS: The same as for dequeue()
+
+    RETURN: Result code, ERROR_POSITION if the queue has less data
+  */
+  inline ResultCodes peek(uint8_t *dataBuffer, uint16_t dataLen)
+  {
+    if (dataLen == 0 || dataLen > getUsed())
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    uint16_t chunkLen =
+      min(dataLen, static_cast<uint16_t>(status_.dataLen - status_.head));
+    if (memory_.retrieveStream(
+          status_.dataPosition + status_.head, dataBuffer, chunkLen))
+    {
+      return memory_.getLastResult();
+    }
+    if (dataLen > chunkLen)
+    {
+      memory_.retrieveStream(
+        status_.dataPosition, dataBuffer + chunkLen, dataLen - chunkLen);
+    }
+    return memory_.getLastResult();
+  }
+
+  /*
+    Remove data from the queue without reading it.
+
+    PARAMETERS:
+    dataLen - Number of bytes to be removed.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ getUsed()
+
+    commitFlag - Flag about committing pointers to the journal.
+      - Data type: boolean
+      - Default value: true
+      - Limited range: true, false
+
+    RETURN: Result code, ERROR_POSITION if the queue has less data
+  */
+  inline ResultCodes drop(uint16_t dataLen, bool commitFlag = true)
+  {
+    if (dataLen > getUsed())
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    status_.head = (status_.head + dataLen) % status_.dataLen;
+    return commitFlag ? commit() : memory_.setLastResult();
+  }
+
+  /*
+    Persist head and tail pointers.
+
+    DESCRIPTION:
+    The method writes data batched in the page buffer of the memory and then
+    current pointers with incremented sequence to the next journal slot, which
+    is written instantly as well.
+
+    PARAMETERS: None
+
+    RETURN: Result code
+  */
+  inline ResultCodes commit()
+  {
+    uint8_t slot = (status_.slot + 1) % status_.journalSlots;
+    uint16_t record[JOURNAL_SLOT_LEN / 2] = {
+      static_cast<uint16_t>(status_.sequence + 1), status_.head, status_.tail
+    };
+    record[3] = getCheck(record);
+    if (memory_.flush() ||
+        memory_.storeStream(status_.journalPosition + slot * JOURNAL_SLOT_LEN,
+                            reinterpret_cast<uint8_t *>(record),
+                            JOURNAL_SLOT_LEN) ||
+        memory_.flush())
+    {
+      return memory_.getLastResult();
+    }
+    status_.slot = slot;
+    status_.sequence++;
+    return memory_.getLastResult();
+  }
+
+  /*
+    Remove all data from the queue.
+
+    PARAMETERS: None
+
+    RETURN: Result code
+  */
+  inline ResultCodes clear()
+  {
+    status_.head = status_.tail;
+    return commit();
+  }
+
+  // Getters
+  inline uint16_t getCapacity() { return status_.dataLen - 1; }
+  inline uint16_t getUsed()
+  {
+    return (status_.tail + status_.dataLen - status_.head) % status_.dataLen;
+  }
+  inline uint16_t getFree() { return getCapacity() - getUsed(); }
+  inline bool isEmpty() { return status_.head == status_.tail; }
+  inline uint16_t getSequence() { return status_.sequence; }
+
+private:
+  MEMORY &memory_;
+  struct Status
+  {
+    uint16_t journalPosition;
+    uint16_t dataPosition;
+    uint16_t dataLen;
+    // Offsets of the oldest data and the next free byte in the ring buffer
+    uint16_t head;
+    uint16_t tail;
+    // Sequence of the recent journal record and its slot
+    uint16_t sequence;
+    uint8_t slot;
+    uint8_t journalSlots;
+  } status_;
+
+  inline uint16_t getCheck(const uint16_t *record)
+  {
+    return record[0] ^ record[1] ^ record[2] ^ 0xA55A;
+  }
+
+  // Find the journal record with the highest valid sequence
+  inline ResultCodes recover()
+  {
+    bool found = false;
+    for (uint8_t slot = 0; slot < status_.journalSlots; slot++)
+    {
+      uint16_t record[JOURNAL_SLOT_LEN / 2];
+      if (memory_.retrieve(status_.journalPosition + slot * JOURNAL_SLOT_LEN,
+                           record))
+      {
+        return memory_.getLastResult();
+      }
+      if (record[3] != getCheck(record) || record[1] >= status_.dataLen ||
+          record[2] >= status_.dataLen)
+      {
+        continue;
+      }
+      // Serial number arithmetic survives sequence overflow
+      if (!found ||
+          static_cast<int16_t>(record[0] - status_.sequence) > 0)
+      {
+        found = true;
+        status_.sequence = record[0];
+        status_.head = record[1];
+        status_.tail = record[2];
+        status_.slot = slot;
+      }
+    }
+    return memory_.getLastResult();
+  }
+};
+// Queue in the memory with the address policy selectable at run time
+typedef gbj_memory_queue_t<> gbj_memory_queue;
+GBJ_MEMORY_STATIC_END
+
+#endif
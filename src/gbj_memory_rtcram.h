@@ -0,0 +1,88 @@
+/*
+  NAME:
+  gbjMemoryRtcRam
+
+  DESCRIPTION:
+  Shadowed access to battery backed RAM of real time clock chips, e.g., 56
+  bytes of DS1307 starting at the real position 0x08, managed by the library
+  gbjMemory.
+  - The class is the memory shadow with the whole shadow as one page, so that
+    all reads are served from the shadow and the dirty range from the first to
+    the last changed byte is written back with one burst at flush().
+  - The RAM is written instantly, so that the memory should be initialized
+    with the page size equal to its capacity. The flush suspends the write
+    delay of the memory and restores it afterwards, so that the memory object
+    can be shared with other devices at the same address.
+  - The template parameter is the length of the shadow in bytes, which should
+    be at least the capacity of the memory.
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#ifndef GBJ_MEMORY_RTCRAM_H
+#define GBJ_MEMORY_RTCRAM_H
+
+#include "gbj_memory_shadow.h"
+
+GBJ_MEMORY_STATIC_BEGIN
+template<uint16_t LEN = 56, class MEMORY = gbj_memory>
+class gbj_memory_rtcram : public gbj_memory_shadow<LEN, LEN, MEMORY>
+{
+public:
+  typedef typename MEMORY::ResultCodes ResultCodes;
+
+  gbj_memory_rtcram(MEMORY &memory)
+    : gbj_memory_shadow<LEN, LEN, MEMORY>(memory){};
+
+  /*
+    Load shadow from the memory.
+
+    DESCRIPTION:
+    The method reads the whole capacity of the memory to the shadow in one
+    burst. Pending dirty bytes are discarded.
+
+    PARAMETERS: None
+
+    RETURN: Result code, ERROR_POSITION if the memory is longer than the
+    shadow or its page size is shorter than its capacity
+  */
+  inline ResultCodes begin()
+  {
+    if (this->memory_.getPageSize() < this->memory_.getCapacityByte())
+    {
+      return this->memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    return gbj_memory_shadow<LEN, LEN, MEMORY>::begin();
+  }
+
+  /*
+    Write dirty range to the memory.
+
+    DESCRIPTION:
+    The method writes the range from the first to the last changed byte of the
+    shadow to the memory in one burst without the write delay of the memory.
+
+    PARAMETERS: None
+
+    RETURN: Result code
+  */
+  inline ResultCodes flush()
+  {
+    uint32_t delay = this->memory_.getDelaySend();
+    this->memory_.setDelaySend(0);
+    ResultCodes result = gbj_memory_shadow<LEN, LEN, MEMORY>::flush();
+    this->memory_.setDelaySend(delay);
+    return this->memory_.setLastResult(result);
+  }
+
+  // Getters
+  inline uint32_t getFlushes() { return this->getPageWrites(); }
+};
+GBJ_MEMORY_STATIC_END
+
+#endif
@@ -0,0 +1,309 @@
+/*
+  NAME:
+  gbjMemoryShadow
+
+  DESCRIPTION:
+  Whole memory shadow in RAM of the microcontroller for small memories managed
+  by the library gbjMemory, e.g., AT24C01/02, RTC RAM, or AT24C32 on ESP32.
+  - The whole memory is loaded to the shadow with one streaming read at start.
+    All reads are served from the shadow without any bus traffic.
+  - Writes update the shadow, mark changed pages in the dirty page bitmap, and
+    extend the dirty range from the first to the last changed byte. Every
+    dirty page limited by the dirty range is written in one burst at flush().
+  - The background consistency check compares one clean page with the memory
+    per call, so that it can be called from the loop() function and catches
+    external modification of the memory, e.g., by another bus master.
+  - The template parameters are the length of the shadow in bytes, which
+    should be at least the capacity of the memory, and the page granularity
+    of dirty tracking, which should divide the page size of the memory, or be
+    at least the capacity of a memory written as one page, e.g., RTC RAM.
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#ifndef GBJ_MEMORY_SHADOW_H
+#define GBJ_MEMORY_SHADOW_H
+
+#include "gbj_memory.h"
+
+GBJ_MEMORY_STATIC_BEGIN
+template<uint16_t LEN, uint16_t PAGE, class MEMORY = gbj_memory>
+class gbj_memory_shadow
+{
+public:
+  static_assert(PAGE > 0 && LEN % PAGE == 0,
+                "Shadow must consist of whole pages");
+  typedef typename MEMORY::ResultCodes ResultCodes;
+
+  static const uint16_t PAGES = LEN / PAGE;
+  static const uint16_t BITMAP_LEN = (PAGES + 7) / 8;
+
+  gbj_memory_shadow(MEMORY &memory)
+    : memory_(memory)
+  {
+    memset(bitmap_, 0, BITMAP_LEN);
+  };
+
+  /*
+    Load shadow from the memory.
+
+    DESCRIPTION:
+    The method reads the whole capacity of the memory to the shadow in one
+    burst. Dirty pages are discarded.
+
+    PARAMETERS: None
+
+    RETURN: Result code, ERROR_POSITION if the memory is longer than the
+    shadow or the page granularity straddles memory pages
+  */
+  inline ResultCodes begin()
+  {
+    if (memory_.getCapacityByte() > LEN ||
+        (memory_.getPageSize() % PAGE &&
+         memory_.getPageSize() < memory_.getCapacityByte()))
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    memset(bitmap_, 0, BITMAP_LEN);
+    status_ = Status();
+    return memory_.retrieveStream(0, shadow_, memory_.getCapacityByte());
+  }
+
+  /*
+    Write data to the shadow.
+
+    DESCRIPTION:
+    The methods copy data to the shadow, mark pages with changed bytes as
+    dirty, and extend the dirty range. The memory is not accessed until
+    flush().
+
+    PARAMETERS:
+    position - Logical memory position where the storing should start.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - 1)
+
+    dataBuffer - Pointer to the byte data buffer or referenced data.
+      - Data type: non-negative integer or T
+      - Default value: none
+      - Limited range: address space
+
+    dataLen - Number of bytes to be stored.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 1 ~ (getCapacityByte() - position)
+
+    RETURN: Result code, ERROR_POSITION if data exceed the memory
+  */
+  inline ResultCodes storeStream(uint16_t position,
+                                 const uint8_t *dataBuffer,
+                                 uint16_t dataLen)
+  {
+    if (checkPosition(position, dataLen))
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    for (uint16_t i = 0; i < dataLen; i++, position++)
+    {
+      if (shadow_[position] != dataBuffer[i])
+      {
+        shadow_[position] = dataBuffer[i];
+        setDirty(position / PAGE, true);
+        status_.dirtyBegin =
+          status_.dirtyEnd ? min(status_.dirtyBegin, position) : position;
+        status_.dirtyEnd =
+          max(status_.dirtyEnd, static_cast<uint16_t>(position + 1));
+      }
+    }
+    return memory_.setLastResult();
+  }
+  template<class T>
+  inline ResultCodes store(uint16_t position, const T &data)
+  {
+    return storeStream(
+      position, reinterpret_cast<const uint8_t *>(&data), sizeof(T));
+  }
+
+  /*
+    Read data from the shadow.
+
+    PARAMETERS: The same as for storing
+
+    RETURN: Result code, ERROR_POSITION if data exceed the memory
+  */
+  inline ResultCodes retrieveStream(uint16_t position,
+                                    uint8_t *dataBuffer,
+                                    uint16_t dataLen)
+  {
+    if (checkPosition(position, dataLen))
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    memcpy(dataBuffer, shadow_ + position, dataLen);
+    return memory_.setLastResult();
+  }
+  template<class T>
+  inline ResultCodes retrieve(uint16_t position, T &data)
+  {
+    return retrieveStream(
+      position, reinterpret_cast<uint8_t *>(&data), sizeof(T));
+  }
+
+  /*
+    Write dirty pages to the memory.
+
+    DESCRIPTION:
+    The method writes every dirty page limited by the dirty range in one bus
+    transaction, so that inner dirty pages are written as whole aligned pages.
+    A page stays dirty if its writing fails.
+
+    PARAMETERS: None
+
+    RETURN: Result code of the first failed page or success
+  */
+  inline ResultCodes flush()
+  {
+    for (uint16_t page = 0; page < PAGES; page++)
+    {
+      if (!isDirty(page))
+      {
+        continue;
+      }
+      uint16_t begin = max(static_cast<uint16_t>(page * PAGE),
+                           status_.dirtyBegin);
+      uint16_t end = min(static_cast<uint16_t>(page * PAGE + PAGE),
+                         status_.dirtyEnd);
+      if (memory_.storeStream(begin, shadow_ + begin, end - begin))
+      {
+        return memory_.getLastResult();
+      }
+      setDirty(page, false);
+      status_.pageWrites++;
+      status_.bytesWritten += end - begin;
+    }
+    status_.dirtyBegin = status_.dirtyEnd = 0;
+    return memory_.setLastResult();
+  }
+
+  /*
+    Check consistency of the next clean page.
+
+    DESCRIPTION:
+    The method reads the next clean page in rotation and compares it with the
+    shadow. At mismatch the memory has been modified externally, so that the
+    page is reloaded to the shadow. Dirty pages are skipped, because their
+    shadow is newer than the memory.
+
+    PARAMETERS: None
+
+    RETURN: Result code, ERROR_RCV_DATA at mismatch
+  */
+  inline ResultCodes check()
+  {
+    uint16_t pages = (memory_.getCapacityByte() + PAGE - 1) / PAGE;
+    for (uint16_t i = 0; i < pages; i++)
+    {
+      uint16_t page = status_.checkPage;
+      status_.checkPage = (page + 1) % pages;
+      if (isDirty(page))
+      {
+        continue;
+      }
+      // The last page is limited by the capacity
+      uint16_t pageLen = min(static_cast<uint32_t>(PAGE),
+                             memory_.getCapacityByte() - page * PAGE);
+      uint8_t buffer[PAGE];
+      if (memory_.retrieveStream(page * PAGE, buffer, pageLen))
+      {
+        return memory_.getLastResult();
+      }
+      status_.checks++;
+      if (memcmp(buffer, shadow_ + page * PAGE, pageLen))
+      {
+        memcpy(shadow_ + page * PAGE, buffer, pageLen);
+        status_.mismatches++;
+        status_.mismatchPage = page;
+        return memory_.setLastResult(ResultCodes::ERROR_RCV_DATA);
+      }
+      break;
+    }
+    return memory_.getLastResult();
+  }
+
+  // Getters
+  inline bool isDirty() { return status_.dirtyEnd > 0; }
+  inline bool isDirty(uint16_t page)
+  {
+    return bitmap_[page / 8] & (1 << (page % 8));
+  }
+  inline uint16_t getDirtyPages()
+  {
+    uint16_t count = 0;
+    for (uint16_t page = 0; page < PAGES; page++)
+    {
+      count += isDirty(page);
+    }
+    return count;
+  }
+  inline uint16_t getDirtyLen()
+  {
+    return status_.dirtyEnd - status_.dirtyBegin;
+  }
+  inline uint32_t getPageWrites() { return status_.pageWrites; }
+  inline uint32_t getBytesWritten() { return status_.bytesWritten; }
+  inline uint32_t getChecks() { return status_.checks; }
+  inline uint32_t getMismatches() { return status_.mismatches; }
+  inline uint16_t getMismatchPage() { return status_.mismatchPage; }
+
+protected:
+  MEMORY &memory_;
+
+private:
+  uint8_t shadow_[LEN];
+  uint8_t bitmap_[BITMAP_LEN];
+  struct Status
+  {
+    // Range of changed bytes, end exclusive, nothing dirty if zero
+    uint16_t dirtyBegin;
+    uint16_t dirtyEnd;
+    // Number of pages and bytes written since start
+    uint32_t pageWrites;
+    uint32_t bytesWritten;
+    // Next page of the consistency check
+    uint16_t checkPage;
+    // Number of checked pages and found mismatches since start
+    uint32_t checks;
+    uint32_t mismatches;
+    // Page of the recent mismatch
+    uint16_t mismatchPage;
+  } status_ = Status();
+
+  inline void setDirty(uint16_t page, bool dirty)
+  {
+    if (dirty)
+    {
+      bitmap_[page / 8] |= 1 << (page % 8);
+    }
+    else
+    {
+      bitmap_[page / 8] &= ~(1 << (page % 8));
+    }
+  }
+  inline ResultCodes checkPosition(uint16_t position, uint16_t dataLen)
+  {
+    if (dataLen == 0 || static_cast<uint32_t>(position) + dataLen >
+                          memory_.getCapacityByte())
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    return memory_.setLastResult();
+  }
+};
+GBJ_MEMORY_STATIC_END
+
+#endif
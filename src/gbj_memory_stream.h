@@ -0,0 +1,278 @@
+/*
+  NAME:
+  gbjMemoryStream
+
+  DESCRIPTION:
+  Sequential writer with the interface Print and reader with the interface
+  Stream over a region of a memory managed by the library gbjMemory, e.g., for
+  text or binary logs written by print() and write().
+  - The writer accumulates bytes in the buffer aligned to memory pages and
+    programs a page only when it is complete, or its pending part at flush().
+    So that logging costs one page program per memory page instead of one per
+    call.
+  - The reader reads the region in chunks of the buffer length, so that bytes
+    are mostly provided from RAM.
+  - The template parameter is the length of the buffer in bytes, which should
+    be at least the page size of the memory for the writer.
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#ifndef GBJ_MEMORY_STREAM_H
+#define GBJ_MEMORY_STREAM_H
+
+#include "gbj_memory.h"
+
+GBJ_MEMORY_STATIC_BEGIN
+template<uint16_t PAGE, class MEMORY = gbj_memory>
+class gbj_memory_writer : public Print
+{
+public:
+  static_assert(PAGE > 0, "Buffer length must be positive");
+  typedef typename MEMORY::ResultCodes ResultCodes;
+
+  gbj_memory_writer(MEMORY &memory)
+    : memory_(memory){};
+
+  /*
+    Initialize writer in a memory region.
+
+    PARAMETERS:
+    position - Logical memory position of the region start.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - 1)
+
+    regionLen - Length of the region in bytes.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 1 ~ (getCapacityByte() - position)
+
+    RETURN: Result code, ERROR_POSITION if the memory page is longer than the
+    buffer or the region exceeds the memory
+  */
+  inline ResultCodes begin(uint16_t position, uint16_t regionLen)
+  {
+    status_.pageSize = memory_.getPageSize();
+    if (status_.pageSize > PAGE || regionLen == 0 ||
+        static_cast<uint32_t>(position) + regionLen > memory_.getCapacityByte())
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    status_.position = position;
+    status_.start = position;
+    status_.end = static_cast<uint32_t>(position) + regionLen;
+    status_.pending = 0;
+    return memory_.setLastResult();
+  }
+
+  /*
+    Write bytes to the memory.
+
+    DESCRIPTION:
+    The methods implement the interface Print. They put bytes to the buffer
+    and write it to the memory when a memory page is complete.
+
+    PARAMETERS:
+    data - Written byte.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ 255
+
+    buffer - Pointer to written bytes.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: address space
+
+    size - Number of written bytes.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ 65535
+
+    RETURN: Number of accepted bytes, which is lower at the end of the region
+    or a failed page write. The bytes of a failed page are discarded, even if
+    they have been accepted by a previous call, and the position returns to
+    their start.
+  */
+  virtual size_t write(uint8_t data) { return write(&data, 1); }
+  virtual size_t write(const uint8_t *buffer, size_t size)
+  {
+    size_t written = 0;
+    while (written < size && status_.position < status_.end)
+    {
+      uint16_t offset = status_.position % status_.pageSize;
+      buffer_[offset] = buffer[written++];
+      status_.position++;
+      status_.pending++;
+      uint16_t pending = status_.pending;
+      if (offset + 1 == status_.pageSize && writePending())
+      {
+        // Only bytes committed before the discarded page are accepted
+        return written > pending ? written - pending : 0;
+      }
+    }
+    return written;
+  }
+
+  /*
+    Write pending bytes of the incomplete memory page.
+
+    DESCRIPTION:
+    The method should be called at the end of logging or before powering down
+    the microcontroller, otherwise the pending bytes are lost. The next bytes
+    continue in the same memory page.
+
+    PARAMETERS: None
+
+    RETURN: None
+  */
+  virtual void flush() { writePending(); }
+
+  // Getters
+  inline uint16_t getPosition() { return status_.position; }
+  inline uint16_t getWritten() { return status_.position - status_.start; }
+  inline uint16_t getRemaining() { return status_.end - status_.position; }
+  inline uint16_t getPending() { return status_.pending; }
+
+private:
+  MEMORY &memory_;
+  uint8_t buffer_[PAGE];
+  struct Status
+  {
+    // Logical memory position of the next byte
+    uint16_t position;
+    // Region boundaries, end exclusive
+    uint16_t start;
+    uint32_t end;
+    uint16_t pageSize;
+    // Number of bytes in the buffer not written yet
+    uint16_t pending;
+  } status_ = { 0, 0, 0, 1, 0 };
+
+  inline ResultCodes writePending()
+  {
+    if (status_.pending == 0)
+    {
+      return ResultCodes::SUCCESS;
+    }
+    uint16_t position = status_.position - status_.pending;
+    if (memory_.storeStream(position,
+                            buffer_ + position % status_.pageSize,
+                            status_.pending) == ResultCodes::SUCCESS)
+    {
+      status_.pending = 0;
+    }
+    else
+    {
+      // Bytes of the failed page are discarded
+      status_.position = position;
+      status_.pending = 0;
+    }
+    return memory_.getLastResult();
+  }
+};
+
+template<uint16_t PAGE, class MEMORY = gbj_memory>
+class gbj_memory_reader : public Stream
+{
+public:
+  static_assert(PAGE > 0, "Buffer length must be positive");
+  typedef typename MEMORY::ResultCodes ResultCodes;
+
+  gbj_memory_reader(MEMORY &memory)
+    : memory_(memory){};
+
+  /*
+    Initialize reader in a memory region.
+
+    PARAMETERS: The same as for the writer
+
+    RETURN: Result code, ERROR_POSITION if the region exceeds the memory
+  */
+  inline ResultCodes begin(uint16_t position, uint16_t regionLen)
+  {
+    if (regionLen == 0 ||
+        static_cast<uint32_t>(position) + regionLen > memory_.getCapacityByte())
+    {
+      return memory_.setLastResult(ResultCodes::ERROR_POSITION);
+    }
+    status_.position = position;
+    status_.end = static_cast<uint32_t>(position) + regionLen;
+    status_.bufferLen = 0;
+    return memory_.setLastResult();
+  }
+
+  /*
+    Read bytes from the memory.
+
+    DESCRIPTION:
+    The methods implement the interface Stream. A byte outside the buffer
+    causes reading the next chunk of the region to the buffer.
+
+    PARAMETERS: None
+
+    RETURN: Number of bytes till the end of the region, or the next byte or -1
+    at the end of the region or a failed reading
+  */
+  virtual int available()
+  {
+    return min(status_.end - status_.position, static_cast<uint32_t>(0x7FFF));
+  }
+  virtual int read()
+  {
+    int data = peek();
+    if (data >= 0)
+    {
+      status_.position++;
+    }
+    return data;
+  }
+  virtual int peek()
+  {
+    if (status_.position >= status_.end)
+    {
+      return -1;
+    }
+    if (status_.position < status_.bufferPosition ||
+        status_.position >= status_.bufferPosition + status_.bufferLen)
+    {
+      uint16_t chunkLen = min(status_.end - status_.position,
+                              static_cast<uint32_t>(PAGE));
+      if (memory_.retrieveStream(status_.position, buffer_, chunkLen))
+      {
+        status_.bufferLen = 0;
+        return -1;
+      }
+      status_.bufferPosition = status_.position;
+      status_.bufferLen = chunkLen;
+    }
+    return buffer_[status_.position - status_.bufferPosition];
+  }
+  // The reader does not write
+  virtual size_t write(uint8_t) { return 0; }
+
+  // Getters
+  inline uint16_t getPosition() { return status_.position; }
+
+private:
+  MEMORY &memory_;
+  uint8_t buffer_[PAGE];
+  struct Status
+  {
+    // Logical memory position of the next byte
+    uint16_t position;
+    // End of the region, exclusive
+    uint32_t end;
+    // Memory position and number of bytes in the buffer
+    uint16_t bufferPosition;
+    uint16_t bufferLen;
+  } status_ = { 0, 0, 0, 0 };
+};
+GBJ_MEMORY_STATIC_END
+
+#endif
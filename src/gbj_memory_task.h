@@ -0,0 +1,151 @@
+/*
+  NAME:
+  gbjMemoryTask
+
+  DESCRIPTION:
+  Stackless cooperative tasks for sequences of operations of a memory managed
+  by the library gbjMemory in the style of protothreads, e.g., reading a
+  header, updating a record, and writing the header.
+  - A task is a function returning the task state, which is called repeatedly
+    from the loop() function. Its body is enclosed by macros GBJ_TASK_BEGIN and
+    GBJ_TASK_END, and it reads sequentially.
+  - The macro GBJ_TASK_CALL returns from the task function while the deferred
+    write cycle of the memory is in progress and resumes at the same place at
+    the next call, so that the task never blocks the loop() function. Then it
+    runs the memory operation and ends the task at failure.
+  - The memory should be in the sleep write mode set by its method
+    setWriteSleep(), so that write cycles are deferred. Bus transactions
+    themselves are synchronous. An operation should not write more than one
+    memory page, otherwise it waits for write cycles of preceding pages.
+  - The task state is just a resume point and the last result code, no heap
+    or stack is retained. Local variables of the task function do not survive
+    yielding, so that they should be static or members.
+  - The switch statement of the task body cannot contain other switch
+    statements spanning the macros.
+  - The task function returns gbj_memory_task::States for tasks of every
+    memory type.
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#ifndef GBJ_MEMORY_TASK_H
+#define GBJ_MEMORY_TASK_H
+
+#include "gbj_memory.h"
+
+// Intended fall through to the resume point of a yield
+#if defined(__has_attribute)
+  #if __has_attribute(fallthrough)
+    #define GBJ_TASK_FALLTHROUGH __attribute__((fallthrough))
+  #endif
+#endif
+#if !defined(GBJ_TASK_FALLTHROUGH)
+  #define GBJ_TASK_FALLTHROUGH
+#endif
+
+// Start of the task body resuming at the last yield point
+#define GBJ_TASK_BEGIN(task)                                                   \
+  switch ((task).getLine())                                                    \
+  {                                                                            \
+    case 0:
+
+// Yield until the condition is met
+#define GBJ_TASK_AWAIT(task, condition)                                        \
+  do                                                                           \
+  {                                                                            \
+    (task).setLine(__LINE__);                                                  \
+    GBJ_TASK_FALLTHROUGH;                                                      \
+    case __LINE__:                                                             \
+      if (!(condition))                                                        \
+      {                                                                        \
+        return gbj_memory_task::TASK_RUNNING;                                  \
+      }                                                                        \
+  } while (0)
+
+// Yield once to other tasks
+#define GBJ_TASK_YIELD(task)                                                   \
+  do                                                                           \
+  {                                                                            \
+    (task).setLine(__LINE__);                                                  \
+    return gbj_memory_task::TASK_RUNNING;                                      \
+    case __LINE__:;                                                            \
+  } while (0)
+
+// Yield while the memory is busy, then run the operation and end at failure
+#define GBJ_TASK_CALL(task, operation)                                         \
+  do                                                                           \
+  {                                                                            \
+    GBJ_TASK_AWAIT(task, (task).isReady());                                    \
+    if ((task).setResult(operation))                                           \
+    {                                                                          \
+      (task).setLine(0);                                                       \
+      return gbj_memory_task::TASK_FAILED;                                     \
+    }                                                                          \
+  } while (0)
+
+// End of the task body, the next call starts the task again
+#define GBJ_TASK_END(task)                                                     \
+  }                                                                            \
+  (task).setLine(0);                                                           \
+  return gbj_memory_task::TASK_DONE
+
+GBJ_MEMORY_STATIC_BEGIN
+template<class MEMORY = gbj_memory>
+class gbj_memory_task_t
+{
+public:
+  typedef typename MEMORY::ResultCodes ResultCodes;
+
+  enum States : uint8_t
+  {
+    TASK_RUNNING, // Task yielded and should be called again
+    TASK_DONE, // Task finished successfully
+    TASK_FAILED, // Task finished by failed operation
+  };
+
+  gbj_memory_task_t(MEMORY &memory)
+    : memory_(memory){};
+
+  /*
+    Restart task.
+
+    DESCRIPTION:
+    The method discards the resume point, so that the next call of the task
+    function starts from its beginning.
+
+    PARAMETERS: None
+
+    RETURN: None
+  */
+  inline void restart()
+  {
+    line_ = 0;
+    result_ = ResultCodes::SUCCESS;
+  }
+
+  // Setters used by macros
+  inline void setLine(uint16_t line) { line_ = line; }
+  inline ResultCodes setResult(ResultCodes result) { return result_ = result; }
+
+  // Getters
+  inline uint16_t getLine() { return line_; }
+  inline ResultCodes getResult() { return result_; }
+  inline bool isRunning() { return line_ != 0; }
+  inline bool isReady() { return !memory_.getWriteBusy(); }
+
+private:
+  MEMORY &memory_;
+  // Source line of the resume point, zero at the beginning
+  uint16_t line_ = 0;
+  ResultCodes result_ = ResultCodes::SUCCESS;
+};
+// Task of the memory with the address policy selectable at run time
+typedef gbj_memory_task_t<> gbj_memory_task;
+GBJ_MEMORY_STATIC_END
+
+#endif
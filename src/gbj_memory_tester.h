@@ -0,0 +1,290 @@
+/*
+  NAME:
+  gbjMemoryTester
+
+  DESCRIPTION:
+  Test and characterization engine for memories managed by the library
+  gbjMemory, e.g., for screening incoming lots of EEPROM chips.
+  - It runs march C- and checkerboard tests in memory page bursts.
+  - It measures real write cycle time of every written chunk by acknowledge
+    polling and collects them to a histogram.
+  - It finds the highest bus clock, at which the memory works reliably.
+  - All tests overwrite the tested region of the memory.
+  - Every written chunk is flushed, so that the chip is tested even with
+    write combining of the memory.
+  - The template parameter determines the length of the internal chunk buffer
+    in bytes, which limits the length of a bus burst. The default value fits
+    the two-wire buffer of AVR platforms with word addressing.
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#ifndef GBJ_MEMORY_TESTER_H
+#define GBJ_MEMORY_TESTER_H
+
+#include "gbj_memory.h"
+
+GBJ_MEMORY_STATIC_BEGIN
+template<uint16_t BUFFER_LEN = 30, class MEMORY = gbj_memory>
+class gbj_memory_tester
+{
+public:
+  static_assert(BUFFER_LEN > 0, "Buffer length must be positive");
+  typedef typename MEMORY::ResultCodes ResultCodes;
+
+  static const uint8_t HISTOGRAM_BINS = 16;
+  static const uint16_t HISTOGRAM_STEP = 1000; // Width of a bin in us
+  static const uint16_t POLL_TIMEOUT = 50; // Timeout of write cycle in ms
+
+  struct Report
+  {
+    // Number of failed bytes
+    uint16_t errors;
+    // Logical position of the first failed byte
+    uint16_t errorPosition;
+    // Number of measured write cycles
+    uint16_t writes;
+    // Minimal, maximal, and summary write cycle time in microseconds
+    uint32_t cycleMin;
+    uint32_t cycleMax;
+    uint32_t cycleSum;
+    // Counts of write cycles in bins by HISTOGRAM_STEP, the last one overflow
+    uint16_t histogram[HISTOGRAM_BINS];
+  };
+
+  gbj_memory_tester(MEMORY &memory)
+    : memory_(memory)
+  {
+    resetReport();
+  };
+
+  /*
+    Run march C- test.
+
+    DESCRIPTION:
+    The method runs the march test C- with background pattern 0x00 on a memory
+    region, i.e., elements up(w0), up(r0,w1), up(r1,w0), down(r0,w1),
+    down(r1,w0), up(r0). Every element processes the region by chunks aligned
+    to memory pages, so that a chunk is read and written in one burst.
+    - Failed bytes and write cycle times are accumulated to the report.
+
+    PARAMETERS:
+    position - Logical memory position of the region start.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - 1)
+
+    regionLen - Length of the tested region in bytes.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 1 ~ getCapacityByte()
+
+    RETURN: Result code of the bus communication
+  */
+  inline ResultCodes marchC(uint16_t position, uint16_t regionLen)
+  {
+    if (runElement(position, regionLen, true, false, 0x00, 0x00) ||
+        runElement(position, regionLen, true, true, 0x00, 0xFF) ||
+        runElement(position, regionLen, true, true, 0xFF, 0x00) ||
+        runElement(position, regionLen, false, true, 0x00, 0xFF) ||
+        runElement(position, regionLen, false, true, 0xFF, 0x00))
+    {
+      return memory_.getLastResult();
+    }
+    return runElement(position, regionLen, true, true, 0x00, 0x00, false);
+  }
+
+  /*
+    Run checkerboard test.
+
+    DESCRIPTION:
+    The method writes alternating pattern 0x55 and 0xAA to a memory region,
+    verifies it, and then repeats it with the inverse pattern, so that every
+    bit is tested in both states with opposite neighbors.
+
+    PARAMETERS: The same as for marchC()
+
+    RETURN: Result code of the bus communication
+  */
+  inline ResultCodes checkerboard(uint16_t position, uint16_t regionLen)
+  {
+    if (runElement(position, regionLen, true, false, 0, 0x55) ||
+        runElement(position, regionLen, true, true, 0x55, 0xAA))
+    {
+      return memory_.getLastResult();
+    }
+    return runElement(position, regionLen, true, true, 0xAA, 0, false);
+  }
+
+  /*
+    Find the highest reliable bus clock.
+
+    DESCRIPTION:
+    The method runs the checkerboard test on a memory region at provided bus
+    clocks in their order and returns the first one without errors. The bus
+    clocks should be sorted in descending order. The bus clock of the memory is
+    set to the found one.
+
+    PARAMETERS:
+    position - Logical memory position of the region start.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ (getCapacityByte() - 1)
+
+    regionLen - Length of the tested region in bytes.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 1 ~ getCapacityByte()
+
+    clocks - Pointer to the array of bus clocks in hertz.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: address space
+
+    clocksCount - Number of bus clocks in the array.
+      - Data type: non-negative integer
+      - Default value: none
+      - Limited range: 0 ~ 255
+
+    RETURN: Reliable bus clock in hertz or 0 if there is none
+  */
+  inline uint32_t findClock(uint16_t position,
+                            uint16_t regionLen,
+                            const uint32_t *clocks,
+                            uint8_t clocksCount)
+  {
+    uint32_t clockOrig = memory_.getBusClock();
+    for (uint8_t i = 0; i < clocksCount; i++)
+    {
+      uint16_t errors = report_.errors;
+      memory_.setBusClock(static_cast<typename MEMORY::ClockSpeeds>(clocks[i]));
+      if (checkerboard(position, regionLen) == ResultCodes::SUCCESS &&
+          report_.errors == errors)
+      {
+        return clocks[i];
+      }
+    }
+    memory_.setBusClock(static_cast<typename MEMORY::ClockSpeeds>(clockOrig));
+    return 0;
+  }
+
+  inline void resetReport()
+  {
+    report_ = Report();
+    report_.cycleMin = UINT32_MAX;
+  }
+
+  // Getters
+  inline const Report &getReport() { return report_; }
+  inline uint32_t getCycleAverage()
+  {
+    return report_.writes ? report_.cycleSum / report_.writes : 0;
+  }
+
+private:
+  MEMORY &memory_;
+  Report report_;
+
+  // Process the region by page aligned chunks in one direction, optionally
+  // verifying the expected pattern and writing the new one
+  inline ResultCodes runElement(uint16_t position,
+                                uint16_t regionLen,
+                                bool ascending,
+                                bool verifyFlag,
+                                uint8_t expected,
+                                uint8_t pattern,
+                                bool writeFlag = true)
+  {
+    uint8_t buffer[BUFFER_LEN];
+    uint16_t pageSize = memory_.getPageSize();
+    uint16_t done = 0;
+    uint32_t delaySend = memory_.getDelaySend();
+    memory_.setDelaySend(0);
+    while (done < regionLen)
+    {
+      // Chunk boundaries from the start or from the end of the region
+      uint16_t chunkPos, chunkLen;
+      if (ascending)
+      {
+        chunkPos = position + done;
+        chunkLen = pageSize - chunkPos % pageSize;
+      }
+      else
+      {
+        chunkPos = position + regionLen - done;
+        chunkLen = (chunkPos - 1) % pageSize + 1;
+      }
+      chunkLen = min(chunkLen, static_cast<uint16_t>(regionLen - done));
+      chunkLen = min(chunkLen, BUFFER_LEN);
+      if (!ascending)
+      {
+        chunkPos -= chunkLen;
+      }
+      if (verifyFlag)
+      {
+        if (memory_.retrieveStream(chunkPos, buffer, chunkLen))
+        {
+          break;
+        }
+        for (uint16_t i = 0; i < chunkLen; i++)
+        {
+          if (buffer[i] != getPattern(expected, chunkPos + i))
+          {
+            if (report_.errors++ == 0)
+            {
+              report_.errorPosition = chunkPos + i;
+            }
+          }
+        }
+      }
+      if (writeFlag)
+      {
+        for (uint16_t i = 0; i < chunkLen; i++)
+        {
+          buffer[i] = getPattern(pattern, chunkPos + i);
+        }
+        // Chunk held in the page buffer of write combining is programmed
+        if (memory_.storeStream(chunkPos, buffer, chunkLen) ||
+            memory_.flush())
+        {
+          break;
+        }
+        uint32_t timestamp = micros();
+        if (memory_.pollAck(POLL_TIMEOUT))
+        {
+          break;
+        }
+        recordCycle(micros() - timestamp);
+      }
+      done += chunkLen;
+    }
+    memory_.setDelaySend(delaySend);
+    return memory_.getLastResult();
+  }
+  // Checkerboard patterns alternate by position, solid ones are constant
+  inline uint8_t getPattern(uint8_t pattern, uint16_t position)
+  {
+    if (pattern == 0x55 || pattern == 0xAA)
+    {
+      return position % 2 ? ~pattern : pattern;
+    }
+    return pattern;
+  }
+  inline void recordCycle(uint32_t cycle)
+  {
+    report_.writes++;
+    report_.cycleSum += cycle;
+    report_.cycleMin = min(report_.cycleMin, cycle);
+    report_.cycleMax = max(report_.cycleMax, cycle);
+    report_.histogram[min(cycle / HISTOGRAM_STEP,
+                          static_cast<uint32_t>(HISTOGRAM_BINS - 1))]++;
+  }
+};
+GBJ_MEMORY_STATIC_END
+
+#endif
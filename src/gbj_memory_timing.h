@@ -0,0 +1,195 @@
+/*
+  NAME:
+  gbjMemoryTiming
+
+  DESCRIPTION:
+  Timing model of two-wire bus transactions of the library gbjMemory for
+  predicting their duration offline, e.g., by the host trace analyzer.
+  - The model counts start, repeated start, and stop conditions with their
+    setup and hold times, bus free time between transactions, and 9 clocks per
+    byte including the acknowledge bit and device address.
+  - Minimal timing of standard, fast, and fast plus bus modes is taken from
+    the I2C specification. The bit period is the longer of the clock period
+    and the minimal low and high periods of the clock with its rise time.
+  - Clock stretching by the slave device is modeled as an extension of the
+    acknowledge bit of every byte.
+  - Write cycle of an EEPROM is modeled by its typical and maximal duration
+    added to every page write, so that predictions of operations include the
+    distribution of write cycles.
+  - The break-even gap of batch reads of the library is computed by this
+    model at the bus clock set, so that the library and host tools agree.
+  - All durations are in nanoseconds, except write cycles in microseconds.
+  - The header does not depend on Arduino framework, so that it can be
+    included in host applications as well.
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#ifndef GBJ_MEMORY_TIMING_H
+#define GBJ_MEMORY_TIMING_H
+
+#include "gbj_memory_trace.h"
+#include <stdint.h>
+
+namespace gbj_memory_timing
+{
+  struct BusTiming
+  {
+    // Bus clock in Hz
+    uint32_t clock;
+    // Minimal low and high period of the clock, and maximal rise time
+    uint16_t low;
+    uint16_t high;
+    uint16_t rise;
+    // Hold time of (repeated) start condition
+    uint16_t holdStart;
+    // Setup time of repeated start and stop conditions
+    uint16_t setupStart;
+    uint16_t setupStop;
+    // Bus free time between stop and start conditions
+    uint16_t busFree;
+  };
+
+  const BusTiming BUS_STANDARD = { 100000, 4700, 4000, 1000,
+                                   4000,   4700, 4000, 4700 };
+  const BusTiming BUS_FAST = { 400000, 1300, 600, 300, 600, 600, 600, 1300 };
+  const BusTiming BUS_FAST_PLUS = { 1000000, 500, 260, 120,
+                                    260,     260, 260, 500 };
+
+  struct WriteCycle
+  {
+    // Duration of the page write cycle in microseconds
+    uint32_t typical;
+    uint32_t maximal;
+  };
+
+  // Usual EEPROM of the AT24C and 24LC families
+  const WriteCycle WRITE_EEPROM = { 3000, 5000 };
+
+  // Software overhead of a bus transaction in microseconds
+  const uint8_t TRANSACTION_OVERHEAD = 20;
+
+  // Timing of the slowest bus mode supporting the clock at that clock
+  inline BusTiming busTiming(uint32_t clock)
+  {
+    BusTiming bus = clock <= BUS_STANDARD.clock
+                      ? BUS_STANDARD
+                      : (clock <= BUS_FAST.clock ? BUS_FAST : BUS_FAST_PLUS);
+    bus.clock = clock ? clock : bus.clock;
+    return bus;
+  }
+
+  // Period of one bit on the bus
+  inline uint32_t bitTime(const BusTiming &bus)
+  {
+    uint32_t period = 1000000000UL / bus.clock;
+    uint32_t periodMin = bus.low + bus.high + bus.rise;
+    return period > periodMin ? period : periodMin;
+  }
+
+  // Bytes with acknowledge bits and clock stretching
+  inline uint32_t bytesTime(const BusTiming &bus,
+                            uint32_t bytes,
+                            uint16_t stretch = 0)
+  {
+    return bytes * (9 * bitTime(bus) + stretch);
+  }
+
+  // Transfer from start to stop condition followed by bus free time
+  inline uint32_t transferTime(const BusTiming &bus,
+                               uint32_t bytes,
+                               uint16_t stretch = 0)
+  {
+    return bus.holdStart + bytesTime(bus, bytes, stretch) + bus.setupStop +
+           bus.busFree;
+  }
+
+  /*
+    Duration of a traced transaction.
+
+    DESCRIPTION:
+    The function models a transaction of a trace record type with the device
+    address and position prefix.
+    - A page write sends the device address, prefix, and data in one transfer
+      followed by the write cycle, if it is provided.
+    - An addressed read sends the device address and prefix, then repeated
+      start with the device address, and receives data.
+    - A current address read sends the device address and receives data.
+    - Acknowledge polling repeats the device address not acknowledged during
+      the write cycle, the last attempt sends the prefix. If the write cycle
+      is provided, failed attempts are included in it.
+    - A bus clear generates 9 clock pulses and stop condition.
+
+    PARAMETERS:
+    bus - Timing of the bus mode.
+    type - Type of the trace record.
+    length - Number of data bytes or polling attempts of the record.
+    prefixLen - Number of bytes of the position prefix.
+    stretch - Clock stretching per byte in nanoseconds.
+    writeCycle - Duration of the write cycle in microseconds, e.g., typical or
+    maximal one of WriteCycle, or zero for the bus traffic only.
+
+    RETURN: Duration in nanoseconds
+  */
+  inline uint32_t transactionTime(const BusTiming &bus,
+                                  gbj_memory_trace::TraceTypes type,
+                                  uint16_t length,
+                                  uint8_t prefixLen,
+                                  uint16_t stretch = 0,
+                                  uint32_t writeCycle = 0)
+  {
+    switch (type)
+    {
+      case gbj_memory_trace::TRACE_WRITE:
+        return transferTime(bus, 1 + prefixLen + length, stretch) +
+               writeCycle * 1000;
+      case gbj_memory_trace::TRACE_READ:
+        return bus.holdStart + bytesTime(bus, 1 + prefixLen, stretch) +
+               bus.setupStart + transferTime(bus, 1 + length, stretch);
+      case gbj_memory_trace::TRACE_CURRENT:
+        return transferTime(bus, 1 + length, stretch);
+      case gbj_memory_trace::TRACE_POLL:
+        return (length && !writeCycle ? length - 1 : 0) *
+                 transferTime(bus, 1, stretch) +
+               transferTime(bus, 1 + prefixLen, stretch);
+      case gbj_memory_trace::TRACE_CLEAR:
+        return 9 * bitTime(bus) + bus.setupStop + bus.busFree;
+      default:
+        return 0;
+    }
+  }
+
+  /*
+    Break-even gap between read requests.
+
+    DESCRIPTION:
+    The function computes the number of bytes, which can be read through and
+    discarded in the time of addressing another read request instead, i.e.,
+    the difference of an addressed read and a current address read plus the
+    software overhead of a transaction divided by the duration of a byte.
+
+    PARAMETERS: The same as for transactionTime() and
+    overhead - Software overhead of a transaction in microseconds.
+
+    RETURN: Number of bytes
+  */
+  inline uint16_t breakEvenGap(const BusTiming &bus,
+                               uint8_t prefixLen,
+                               uint16_t stretch = 0,
+                               uint16_t overhead = TRANSACTION_OVERHEAD)
+  {
+    uint32_t addressed = transactionTime(
+      bus, gbj_memory_trace::TRACE_READ, 1, prefixLen, stretch);
+    uint32_t current = transactionTime(
+      bus, gbj_memory_trace::TRACE_CURRENT, 1, prefixLen, stretch);
+    return (addressed - current + overhead * 1000UL) /
+           bytesTime(bus, 1, stretch);
+  }
+}
+
+#endif
@@ -0,0 +1,93 @@
+/*
+  NAME:
+  gbjMemoryTrace
+
+  DESCRIPTION:
+  Compact binary trace of bus transactions of the library gbjMemory for
+  performance analysis on a host computer.
+  - Every transaction is described by a record of 12 bytes with timestamp,
+    type, real memory position, length, duration, and result code.
+  - Records are collected either to a ring buffer provided by the caller or
+    sent directly to a stream, e.g., Serial.
+  - A record is serialized as sync bytes TRACE_SYNC followed by record bytes in
+    little endian order, which is the byte order of all supported platforms.
+  - The header does not depend on Arduino framework, so that it can be
+    included in host applications as well.
+
+  LICENSE:
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the MIT License (MIT).
+
+  CREDENTIALS:
+  Author: Libor Gabaj
+  GitHub: https://github.com/mrkaleArduinoLib/gbj_memory.git
+*/
+#ifndef GBJ_MEMORY_TRACE_H
+#define GBJ_MEMORY_TRACE_H
+
+#include <stdint.h>
+
+namespace gbj_memory_trace
+{
+  // Sync bytes preceding every serialized record
+  const uint8_t TRACE_SYNC[] = { 0xA5, 0x5A };
+  const uint8_t TRACE_RECORD_LEN = 12;
+
+  enum TraceTypes : uint8_t
+  {
+    TRACE_WRITE = 1, // Page write
+    TRACE_READ = 2, // Addressed burst read
+    TRACE_CURRENT = 3, // Read at current address
+    TRACE_POLL = 4, // Acknowledge polling
+    TRACE_CLEAR = 5, // Bus clear recovery
+  };
+
+  struct TraceRecord
+  {
+    // Start of the transaction in microseconds
+    uint32_t timestamp;
+    // Real memory position
+    uint16_t position;
+    // Number of data bytes
+    uint16_t length;
+    // Duration of the transaction in microseconds, saturated
+    uint16_t duration;
+    TraceTypes type;
+    // Result code of the transaction
+    uint8_t result;
+  };
+
+  // Serialize a record to a byte buffer of TRACE_RECORD_LEN bytes
+  inline void pack(const TraceRecord &record, uint8_t *buffer)
+  {
+    for (uint8_t i = 0; i < 4; i++)
+    {
+      buffer[i] = static_cast<uint8_t>(record.timestamp >> (8 * i));
+    }
+    buffer[4] = static_cast<uint8_t>(record.position);
+    buffer[5] = static_cast<uint8_t>(record.position >> 8);
+    buffer[6] = static_cast<uint8_t>(record.length);
+    buffer[7] = static_cast<uint8_t>(record.length >> 8);
+    buffer[8] = static_cast<uint8_t>(record.duration);
+    buffer[9] = static_cast<uint8_t>(record.duration >> 8);
+    buffer[10] = record.type;
+    buffer[11] = record.result;
+  }
+
+  // Deserialize a record from a byte buffer of TRACE_RECORD_LEN bytes
+  inline void unpack(const uint8_t *buffer, TraceRecord &record)
+  {
+    record.timestamp = 0;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+      record.timestamp |= static_cast<uint32_t>(buffer[i]) << (8 * i);
+    }
+    record.position = buffer[4] | buffer[5] << 8;
+    record.length = buffer[6] | buffer[7] << 8;
+    record.duration = buffer[8] | buffer[9] << 8;
+    record.type = static_cast<TraceTypes>(buffer[10]);
+    record.result = buffer[11];
+  }
+}
+
+#endif